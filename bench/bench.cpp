@@ -0,0 +1,290 @@
+#include "../src/Forest.h"
+#include "../src/rgen.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// in-process benchmark over a grid of forest configurations, one CSV row per configuration.
+// usage: path_oram_bench [--sizes n,n..] [--buckets z,z..] [--max-sizes m,m..] [--rp 0,1] [--r none,0.5..]
+//                        [--payload-sizes p,p..] [--evict-rates a,a..] [--dummy-slots s,s..] [--ops <n>] [--seed <n>] [--csv <file>]
+//                        [--ciphers none,chacha,aes] [--server <socket>]
+// every configuration is bulk loaded, then runs --ops random accesses (half reads, half writes) that are timed one
+// by one, so the percentiles are per access latencies without process start, file parsing or output. With --server
+// the buckets live in a running oram_server and the latencies include its round trips. Cipher kinds this build
+// lacks are skipped
+
+#define BENCH_DEFAULT_OPS 100000
+
+struct BenchConfig {
+    size_t dataSize;
+    size_t bucketSize;
+    size_t maxSize;
+    bool ringFlag;
+    std::optional<double> randomReadRatio;
+    size_t payloadSize;
+    // 0 writes back every read path, otherwise one scheduled eviction every evictionRate accesses
+    size_t evictionRate;
+    // ring buckets with this many dummy slots, 0 keeps plain buckets
+    size_t dummySlots;
+    CipherKind cipher;
+};
+
+struct BenchResult {
+    double avgStash;
+    size_t maxStash;
+    double avgTime;
+    uint64_t p50;
+    uint64_t p99;
+    uint64_t p999;
+    double opsPerSecond;
+    double bytesPerAccess;
+    double roundTripsPerAccess;
+    double wireBytesPerAccess;
+    // fraction of the access time spent sealing and opening buckets
+    double cryptoShare;
+};
+
+template <typename T>
+std::vector<T> parseList(const std::string& text, T (*parse)(const std::string&)) {
+    std::vector<T> values;
+    std::istringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        values.push_back(parse(item));
+    }
+    return values;
+}
+
+size_t parseSize(const std::string& text) {
+    return std::stoul(text);
+}
+
+std::optional<double> parseRatio(const std::string& text) {
+    if (text == "none") {
+        return std::nullopt;
+    }
+    return std::stod(text);
+}
+
+CipherKind parseCipher(const std::string& text) {
+    std::optional<CipherKind> kind = parseCipherKind(text);
+    if (!kind.has_value()) {
+        throw std::invalid_argument(text);
+    }
+    return kind.value();
+}
+
+// nanoseconds of the access at the given quantile, latencies must be sorted
+uint64_t percentile(const std::vector<uint64_t>& latencies, double quantile) {
+    if (latencies.empty()) {
+        return 0;
+    }
+    size_t index = static_cast<size_t>(quantile * (latencies.size() - 1) + 0.5);
+    return latencies[std::min(index, latencies.size() - 1)];
+}
+
+BenchResult runBench(const BenchConfig& config, size_t opCount, uint64_t seed, const std::string& serverSocket) {
+    seedRandom(seed);
+    TreeConfig treeConfig;
+    treeConfig.serverSocket = serverSocket;
+    treeConfig.payloadSize = config.payloadSize;
+    treeConfig.evictionRate = config.evictionRate;
+    treeConfig.dummySlots = config.dummySlots;
+    treeConfig.cipher = config.cipher;
+    Forest forest(config.dataSize, config.bucketSize, config.maxSize, treeConfig);
+    std::vector<StorageRecord> records(config.dataSize);
+    for (size_t i = 0; i < config.dataSize; i++) {
+        records[i] = {i, static_cast<int32_t>(randomSizeT(0, INT_MAX)), 0};
+    }
+    forest.bulkLoad(records.data(), records.size());
+
+    std::vector<TraceOp> ops(opCount);
+    for (auto& op : ops) {
+        op.position = randomSizeT(0, config.dataSize - 1);
+        op.op = randomSizeT(0, 1) == 0 ? TRACE_READ : TRACE_WRITE;
+        op.value = op.op == TRACE_WRITE ? static_cast<int32_t>(randomSizeT(0, INT_MAX)) : 0;
+    }
+
+    std::vector<uint64_t> latencies(opCount);
+    BucketTransferStats transfersBefore = forest.getTransferStats();
+    CryptoStats cryptoBefore = forest.getCryptoStats();
+    // stash occupancy summed over the trees after every access
+    double stashSum = 0;
+    size_t stashMax = 0;
+    for (size_t i = 0; i < opCount; i++) {
+        const TraceOp& op = ops[i];
+        auto startTime = std::chrono::steady_clock::now();
+        if (op.op == TRACE_READ) {
+            forest.get(op.position, false, config.randomReadRatio, config.ringFlag);
+        } else {
+            forest.put(op.position, op.value, false, config.randomReadRatio, config.ringFlag);
+        }
+        latencies[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+        size_t stashSize = 0;
+        for (const auto& tree : forest.trees) {
+            stashSize += tree.stash.size();
+        }
+        stashSum += stashSize;
+        stashMax = std::max(stashMax, stashSize);
+    }
+    BucketTransferStats transfersAfter = forest.getTransferStats();
+    CryptoStats cryptoAfter = forest.getCryptoStats();
+
+    BenchResult result;
+    result.avgStash = opCount > 0 ? stashSum / opCount : 0;
+    result.maxStash = stashMax;
+    uint64_t totalNanoseconds = 0;
+    for (uint64_t latency : latencies) {
+        totalNanoseconds += latency;
+    }
+    result.avgTime = opCount > 0 ? static_cast<double>(totalNanoseconds) / opCount : 0;
+    std::sort(latencies.begin(), latencies.end());
+    result.p50 = percentile(latencies, 0.5);
+    result.p99 = percentile(latencies, 0.99);
+    result.p999 = percentile(latencies, 0.999);
+    // throughput over the accesses alone, the stash sampling between them is not counted
+    result.opsPerSecond = totalNanoseconds > 0 ? opCount * 1e9 / totalNanoseconds : 0;
+    result.bytesPerAccess = opCount > 0 ? static_cast<double>(transfersAfter.storeBytes - transfersBefore.storeBytes) / opCount : 0;
+    result.roundTripsPerAccess = opCount > 0 ? static_cast<double>(transfersAfter.roundTrips - transfersBefore.roundTrips) / opCount : 0;
+    result.wireBytesPerAccess = opCount > 0 ? static_cast<double>(transfersAfter.wireBytes - transfersBefore.wireBytes) / opCount : 0;
+    result.cryptoShare = totalNanoseconds > 0 ? static_cast<double>(cryptoAfter.nanoseconds - cryptoBefore.nanoseconds) / totalNanoseconds : 0;
+    return result;
+}
+
+int main(int argc, char** argv) {
+    std::vector<size_t> dataSizes = {100000, 200000};
+    std::vector<size_t> bucketSizes = {4};
+    std::vector<size_t> maxSizes = {MAX_TREE_SIZE, 1000000};
+    std::vector<size_t> ringFlags = {0, 1};
+    std::vector<std::optional<double>> ratios = {std::nullopt};
+    std::vector<size_t> payloadSizes = {0};
+    std::vector<size_t> evictionRates = {0};
+    std::vector<size_t> dummySlotCounts = {0};
+    std::vector<CipherKind> ciphers = {CipherKind::NONE};
+    size_t opCount = BENCH_DEFAULT_OPS;
+    uint64_t seed = 1;
+    std::string csvPath;
+    std::string serverSocket;
+    try {
+        for (int i = 1; i + 1 < argc; i += 2) {
+            std::string flag = argv[i];
+            std::string value = argv[i + 1];
+            if (flag == "--sizes") {
+                dataSizes = parseList<size_t>(value, parseSize);
+            } else if (flag == "--buckets") {
+                bucketSizes = parseList<size_t>(value, parseSize);
+            } else if (flag == "--max-sizes") {
+                maxSizes = parseList<size_t>(value, parseSize);
+            } else if (flag == "--rp") {
+                ringFlags = parseList<size_t>(value, parseSize);
+            } else if (flag == "--r") {
+                ratios = parseList<std::optional<double>>(value, parseRatio);
+            } else if (flag == "--payload-sizes") {
+                payloadSizes = parseList<size_t>(value, parseSize);
+            } else if (flag == "--evict-rates") {
+                evictionRates = parseList<size_t>(value, parseSize);
+            } else if (flag == "--dummy-slots") {
+                dummySlotCounts = parseList<size_t>(value, parseSize);
+            } else if (flag == "--ciphers") {
+                ciphers = parseList<CipherKind>(value, parseCipher);
+            } else if (flag == "--ops") {
+                opCount = parseSize(value);
+            } else if (flag == "--seed") {
+                seed = parseSize(value);
+            } else if (flag == "--csv") {
+                csvPath = value;
+            } else if (flag == "--server") {
+                serverSocket = value;
+            } else {
+                std::cerr << "Unknown flag: " << flag << std::endl;
+                return 1;
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Invalid benchmark arguments." << std::endl;
+        return 1;
+    }
+
+    for (CipherKind cipher : ciphers) {
+        if (!cipherAvailable(cipher)) {
+            std::cerr << cipherKindName(cipher) << " is not available in this build, skipping it." << std::endl;
+        }
+    }
+    // avg_time and the percentiles are per access in nanoseconds
+    std::string header = "operate_size,tree_size,bucket_size,max_size,ring,random_read,payload_size,evict_rate,dummy_slots,cipher,avg_stash,max_stash,"
+                         "avg_time,p50_time,p99_time,p999_time,ops_per_sec,bytes_per_access,"
+                         "round_trips_per_access,wire_bytes_per_access,crypto_share";
+    std::ofstream csvFile;
+    if (!csvPath.empty()) {
+        csvFile.open(csvPath);
+        if (!csvFile) {
+            std::cerr << "Error opening file: " << csvPath << std::endl;
+            return 1;
+        }
+        csvFile << header << "\n";
+    }
+    std::cout << header << std::endl;
+    // the whole grid up front, first flag varying slowest
+    std::vector<BenchConfig> grid;
+    for (size_t dataSize : dataSizes) {
+        for (size_t bucketSize : bucketSizes) {
+            for (size_t maxSize : maxSizes) {
+                for (size_t ringFlag : ringFlags) {
+                    for (const auto& ratio : ratios) {
+                        for (size_t payloadSize : payloadSizes) {
+                            for (size_t evictionRate : evictionRates) {
+                                for (size_t dummySlots : dummySlotCounts) {
+                                    for (CipherKind cipher : ciphers) {
+                                        // ring buckets only exist under scheduled eviction, and are read in place
+                                        if (dummySlots > 0 && (evictionRate == 0 || !serverSocket.empty())) {
+                                            continue;
+                                        }
+                                        if (!cipherAvailable(cipher)) {
+                                            continue;
+                                        }
+                                        grid.push_back({dataSize, bucketSize, maxSize, ringFlag != 0, ratio, payloadSize, evictionRate, dummySlots,
+                                                        cipher});
+                                    }
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+    for (const BenchConfig& config : grid) {
+        BenchResult result;
+        try {
+            result = runBench(config, opCount, seed, serverSocket);
+        } catch (const std::exception& e) {
+            // e.g. no bucket server listening on --server
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+        std::ostringstream row;
+        row << opCount << "," << config.dataSize << "," << config.bucketSize << "," << config.maxSize << "," << config.ringFlag << ",";
+        if (config.randomReadRatio.has_value()) {
+            row << config.randomReadRatio.value();
+        } else {
+            row << "none";
+        }
+        row << "," << config.payloadSize << "," << config.evictionRate << "," << config.dummySlots << ","
+            << cipherKindName(config.cipher) << ","
+            << result.avgStash << "," << result.maxStash << "," << result.avgTime << ","
+            << result.p50 << "," << result.p99 << "," << result.p999 << ","
+            << static_cast<uint64_t>(result.opsPerSecond) << "," << result.bytesPerAccess << ","
+            << result.roundTripsPerAccess << "," << result.wireBytesPerAccess << "," << result.cryptoShare;
+        std::cout << row.str() << std::endl;
+        if (csvFile.is_open()) {
+            csvFile << row.str() << "\n";
+        }
+    }
+    return 0;
+}
@@ -4,7 +4,7 @@
 Write-Host "Building Path-ORAM..." -ForegroundColor Green
 
 # Compile the program
-g++ -std=c++17 -Wall -Wextra -g -o path_oram src/Tree.cpp src/Forest.cpp src/rgen.cpp main/path_oram.cpp
+g++ -std=c++17 -Wall -Wextra -g -pthread -o path_oram src/Tree.cpp src/Forest.cpp src/PositionMap.cpp src/rgen.cpp src/chacha.cpp src/BucketCipher.cpp src/BucketStore.cpp src/StorageFile.cpp src/AccessStats.cpp src/Snapshot.cpp src/RemoteStore.cpp main/path_oram.cpp
 
 if ($LASTEXITCODE -eq 0) {
     Write-Host "Build successful!" -ForegroundColor Green
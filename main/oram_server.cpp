@@ -0,0 +1,41 @@
+#include "../src/RemoteStore.h"
+
+#include <csignal>
+#include <iostream>
+#include <string>
+
+// bucket server for path_oram --server and path_oram_bench --server, holding the trees' buckets on the other side
+// of a UNIX socket so every path read and write-back is a real round trip.
+// usage: oram_server <socket_path> [--store <bucket_file>]
+// with --store every tree's buckets go to a memory-mapped file <bucket_file>.<n> instead of RAM. Runs until
+// SIGINT or SIGTERM, a client that disconnects loses its buckets
+
+static BucketServer* runningServer = nullptr;
+
+static void stopServer(int) {
+    // stop only sets a flag and writes one byte to a pipe, both fine inside a signal handler
+    if (runningServer) {
+        runningServer->stop();
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2 && !(argc == 4 && std::string(argv[2]) == "--store")) {
+        std::cerr << "Usage: oram_server <socket_path> [--store <bucket_file>]" << std::endl;
+        return 1;
+    }
+    try {
+        BucketServer server(argv[1], argc == 4 ? argv[3] : "");
+        runningServer = &server;
+        std::signal(SIGINT, stopServer);
+        std::signal(SIGTERM, stopServer);
+        std::cout << "Serving buckets on " << argv[1] << std::endl;
+        server.run();
+        runningServer = nullptr;
+        std::cout << "Served " << server.servedRequests() << " requests." << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
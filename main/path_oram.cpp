@@ -1,4 +1,5 @@
 #include "../src/Forest.h"
+#include "../src/rgen.h"
 
 #include <fstream>
 #include <iostream>
@@ -10,14 +11,21 @@
 #include <sstream>
 #include <algorithm>
 #include <chrono>
+#include <deque>
+
+// requests the operate command keeps in flight when running with --threads
+#define OPERATE_WINDOW 4096
 
 // use -d to see debug information and use -s to see statistics related with run time and stash sizes
-//command format:  store|operate <file_name> [-s] [--r <random read ratio>] [-d] [--max-size <max_tree_size>] [-rp] ,
-//                 print sizes|trees [output_file] ,
+//command format:  store|operate <file_name> [-s] [--r <random read ratio>] [-d] [--max-size <max_tree_size>] [-rp] [--pm-budget <bytes>] [--encrypt chacha|aes] [--store <bucket_file>] [--server <socket>] [--top-cache-levels <k>] [--payload-size <bytes>] [--evict-rate <A>] [--reshuffle <S>] [--dummy-slots <S>] [--stash-limit <n>] [--stash-watermark <n>] [--placement hash|range] [--threads <n>] [--queue-depth <n>] [--batch <n>] ,
+//                 print sizes|trees|posmap|cache|stats|stats-json [output_file] ,
 //                 get <position> [--r <random read ratio>] [-d] [-rp],
 //                 put <position> <value> [--r <random read ratio>] [-d] [-rp] ,
-//                 newTree <data_size> <bucket_size> <max_tree_size> [-d] ,
+//                 newTree <data_size> <bucket_size> <max_tree_size> [-d] [--pm-budget <bytes>] [--encrypt chacha|aes] [--store <bucket_file>] [--server <socket>] [--top-cache-levels <k>] [--payload-size <bytes>] [--evict-rate <A>] [--reshuffle <S>] [--dummy-slots <S>] [--stash-limit <n>] [--stash-watermark <n>] [--placement hash|range] ,
+//                 convert <text_file> <binary_file> [ops] ,
+//                 save <snapshot_file> , load <snapshot_file> [-s] ,
 //                 exit ,
+// every command also accepts [--seed <n>] [--rng xoshiro|chacha] to reseed or switch the random generator first
 //==================================================================================
 // How to use different optimizations:
 //1. use --max-size to set the maximum nodes of each tree, default is 65535,
@@ -28,12 +36,68 @@
 //==================================================================================
 //3. use --r <random read ratio> to enable random read algorithm, default is disabled,
 // the random read ratio should be between 0 and 1 and represent the probability a read block along the path is put into the stash
+//==================================================================================
+//4. use --pm-budget <bytes> when building the forest to enable the recursive position map,
+// each tree's map is packed into a smaller ORAM tree, recursively, until the client side map fits in the budget.
+// use print posmap to see the per level access cost.
+//==================================================================================
+//5. use --threads <n> with operate to serve the forest with n worker threads, each owning a disjoint group of trees.
+// requests are routed to the owning worker and their results are printed in file order.
+//==================================================================================
+//6. use --batch <n> with operate to serve n requests at a time, the union of their paths is read once
+// and written back once, so shared upper buckets are not moved n times.
+//==================================================================================
+//7. use --encrypt chacha|aes when building the forest to keep every bucket sealed with ChaCha20-Poly1305 or
+// AES-256-GCM (OpenSSL builds only). Each path is opened and resealed in one batch with fresh nonces,
+// and -s reports the share of the run spent in the cipher.
+//==================================================================================
+//8. use --store <bucket_file> when building the forest to keep the buckets in a memory-mapped file instead of RAM,
+// one file per tree (<bucket_file>.<i> when there are several) plus <bucket_file>.map files for recursive maps.
+//==================================================================================
+//9. use --top-cache-levels <k> when building the forest to keep the top k levels of every tree in client memory,
+// only the lower levels go through the bucket store and the cipher. print cache shows the store traffic saved.
+//==================================================================================
+//10. use --payload-size <bytes> when building the forest to give every block a fixed-size payload next to its value.
+// payloads live in their own area of each bucket and of the stash, so eviction only scans the block metadata.
+//==================================================================================
+//11. use save <snapshot_file> after store to write the whole forest to one file, and load <snapshot_file> in a later
+// session to continue from it without replaying the store. The buckets are used in place from the mapped snapshot,
+// sealed trees keep their key in it, so the snapshot has to be kept as private as the client itself.
+//==================================================================================
+//12. use --evict-rate <A> when building the forest to schedule evictions instead of writing back every read path:
+// an access only takes its target block out of each bucket, and every A accesses one path in reverse lexicographic
+// order is read and refilled. A bucket read --reshuffle <S> times (default: the bucket size) since it was last
+// written is reshuffled early. A trades eviction bandwidth against stash size, -rp has no effect in this mode.
+//==================================================================================
+//13. use --dummy-slots <S> together with --evict-rate to switch to ring buckets: every bucket gets S dummy slots and
+// a random slot order that changes on each write, so an access reads one slot per bucket (its target, or an unread
+// dummy) instead of the whole bucket. Buckets are reshuffled after at most S reads, encryption is not supported.
+//==================================================================================
+//14. use --stash-limit <n> when building the forest to bound every stash between accesses: above the watermark
+// (--stash-watermark <w>, default three quarters of n) each access adds one dummy path eviction, above n dummy
+// evictions run until the stash is back under the watermark. print sizes shows how many that took per access.
+//==================================================================================
+//15. a forest of several trees places every position with --placement hash (default) or range. hash runs the position
+// through a keyed permutation and deals the result round robin, so every tree gets an equal share and neighbouring
+// positions land on different trees (and workers), range keeps runs of positions together. Either is computed per
+// access, so the forest keeps no map from positions to trees.
+//==================================================================================
+//16. use --queue-depth <d> with operate to pipeline the accesses: requests go to the workers through
+// Forest::asyncGet/asyncPut, and a worker serves up to d waiting requests of a tree together. Their paths are all
+// fetched before any write-back, they are answered in file order from the stash, then written back once. Without
+// --threads a single worker is started. -s reports how many requests the windows held on average.
+//==================================================================================
+//17. start ./oram_server <socket> and use --server <socket> when building the forest to keep the buckets in that
+// process instead: every tree (and map tree) opens its own connection, a path is fetched with one request straight
+// into the client's staging buffers and write-backs are pipelined behind it. -s and print cache report the round
+// trips and wire bytes per access. Ring buckets cannot be remote, a saved snapshot keeps the buckets locally.
 
 
 // test files format:
-// store: <position> <value>
+// store: <position> <value>, or a binary storage file made by convert, which store maps and bulk loads
+// straight into the buckets instead of replaying one put per entry
 //===============================
-// operate: R <position> , or W <position> <value>
+// operate: R <position> , or W <position> <value>, or a binary op trace made by convert ... ops
 // where R is read operation and W is write operation
 
 
@@ -72,6 +136,127 @@ size_t parseMaxTreeSize(std::vector<std::string>& args) {
     return MAX_TREE_SIZE;
 }
 
+std::optional<size_t> parseSizeFlag(std::vector<std::string>& args, const std::string& flag) {
+    auto it = std::find(args.begin(), args.end(), flag);
+    if (it != args.end()) {
+        if (it + 1 != args.end()) {
+            try {
+                size_t value = std::stoul(*(it + 1));
+                args.erase(it + 1);
+                args.erase(it);
+                return value;
+            } catch (const std::exception& e) {
+                std::cerr << "Invalid value format for " << flag << " parameter." << std::endl;
+                args.erase(it + 1);
+                args.erase(it);
+                return std::nullopt;
+            }
+        } else {
+            std::cerr << "Missing value for " << flag << " parameter." << std::endl;
+            args.erase(it);
+            return std::nullopt;
+        }
+    }
+    return std::nullopt;
+}
+
+std::optional<std::string> parseStringFlag(std::vector<std::string>& args, const std::string& flag) {
+    auto it = std::find(args.begin(), args.end(), flag);
+    if (it == args.end()) {
+        return std::nullopt;
+    }
+    if (it + 1 == args.end()) {
+        std::cerr << "Missing value for " << flag << " parameter." << std::endl;
+        args.erase(it);
+        return std::nullopt;
+    }
+    std::string value = *(it + 1);
+    args.erase(it + 1);
+    args.erase(it);
+    return value;
+}
+
+CipherKind parseCipherFlag(std::vector<std::string>& args) {
+    auto it = std::find(args.begin(), args.end(), "--encrypt");
+    if (it == args.end()) {
+        return CipherKind::NONE;
+    }
+    std::optional<CipherKind> kind;
+    if (it + 1 != args.end()) {
+        kind = parseCipherKind(*(it + 1));
+        args.erase(it + 1);
+    }
+    args.erase(it);
+    if (!kind.has_value()) {
+        std::cerr << "Usage: --encrypt chacha|aes" << std::endl;
+        return CipherKind::NONE;
+    }
+    if (!cipherAvailable(kind.value())) {
+        std::cerr << cipherKindName(kind.value()) << " is not available in this build, falling back to ChaCha20-Poly1305." << std::endl;
+        return CipherKind::CHACHA20_POLY1305;
+    }
+    return kind.value();
+}
+
+PlacementKind parsePlacementFlag(std::vector<std::string>& args) {
+    auto it = std::find(args.begin(), args.end(), "--placement");
+    if (it == args.end()) {
+        return PlacementKind::HASH;
+    }
+    std::string name = it + 1 != args.end() ? *(it + 1) : "";
+    if (it + 1 != args.end()) {
+        args.erase(it + 1);
+    }
+    args.erase(it);
+    if (name == "range") {
+        return PlacementKind::RANGE;
+    }
+    if (name != "hash") {
+        std::cerr << "Usage: --placement hash|range" << std::endl;
+    }
+    return PlacementKind::HASH;
+}
+
+// cipher time spent since before, as a share of the timed region. With --threads the cipher time is summed over workers
+void printCryptoStats(const Forest& forest, const CryptoStats& before, std::chrono::nanoseconds elapsed) {
+    CryptoStats after = forest.getCryptoStats();
+    if (after.sealedBuckets == before.sealedBuckets && after.openedBuckets == before.openedBuckets) {
+        return;
+    }
+    uint64_t cryptoTime = after.nanoseconds - before.nanoseconds;
+    double share = elapsed.count() > 0 ? 100.0 * cryptoTime / elapsed.count() : 0.0;
+    std::cout << "Buckets opened / sealed: " << after.openedBuckets - before.openedBuckets << " / " << after.sealedBuckets - before.sealedBuckets << std::endl;
+    std::cout << "Encryption time: " << cryptoTime / 1000000 << " ms (" << share << "% of execution time)" << std::endl;
+}
+
+// store traffic per access of the timed region, and what the tree-top cache kept off the store
+std::string formatTransferStats(const BucketTransferStats& after, const BucketTransferStats& before) {
+    uint64_t accesses = after.accesses - before.accesses;
+    if (accesses == 0) {
+        return "No accesses yet.\n";
+    }
+    std::ostringstream out;
+    out << "Store buckets per access: " << double(after.storeBuckets - before.storeBuckets) / accesses
+        << " (" << (after.storeBytes - before.storeBytes) / accesses << " bytes)" << std::endl;
+    if (after.storeSlots > before.storeSlots) {
+        out << "Store ring slots per access: " << double(after.storeSlots - before.storeSlots) / accesses << std::endl;
+    }
+    if (after.roundTrips > before.roundTrips) {
+        out << "Server round trips per access: " << double(after.roundTrips - before.roundTrips) / accesses
+            << " (" << (after.wireBytes - before.wireBytes) / accesses << " wire bytes)" << std::endl;
+    }
+    out << "Top cache buckets per access: " << double(after.cachedBuckets - before.cachedBuckets) / accesses
+        << " (" << (after.savedBytes - before.savedBytes) / accesses << " bytes saved, cache holds " << after.cacheBytes << " bytes)" << std::endl;
+    return out.str();
+}
+
+// a submitted operate request whose result is printed in file order once it completes
+struct PendingOperation {
+    bool isRead;
+    size_t position;
+    int value;
+    std::future<std::optional<int>> result;
+};
 
 std::optional<double> parseRandomReadRatio(std::vector<std::string>& args) {
     auto it = std::find(args.begin(), args.end(), "--r");
@@ -121,8 +306,42 @@ int main() {
             args.push_back(arg);
         }
 
+        auto rngIt = std::find(args.begin(), args.end(), "--rng");
+        if (rngIt != args.end()) {
+            RandomEngine engine;
+            if (rngIt + 1 != args.end() && parseRandomEngine(*(rngIt + 1), engine)) {
+                setRandomEngine(engine);
+                args.erase(rngIt + 1);
+            } else {
+                std::cerr << "Usage: --rng xoshiro|chacha" << std::endl;
+                if (rngIt + 1 != args.end()) {
+                    args.erase(rngIt + 1);
+                }
+            }
+            args.erase(rngIt);
+        }
+        std::optional<size_t> seed = parseSizeFlag(args, "--seed");
+        if (seed.has_value()) {
+            seedRandom(seed.value());
+        }
         std::optional<double> randomReadRatio = parseRandomReadRatio(args);
         size_t maxTreeSize = parseMaxTreeSize(args);
+        PlacementKind placement = parsePlacementFlag(args);
+        TreeConfig treeConfig;
+        treeConfig.posMapBudget = parseSizeFlag(args, "--pm-budget");
+        treeConfig.cipher = parseCipherFlag(args);
+        treeConfig.storePath = parseStringFlag(args, "--store").value_or("");
+        treeConfig.serverSocket = parseStringFlag(args, "--server").value_or("");
+        treeConfig.topCacheLevels = parseSizeFlag(args, "--top-cache-levels").value_or(0);
+        treeConfig.payloadSize = parseSizeFlag(args, "--payload-size").value_or(0);
+        treeConfig.evictionRate = parseSizeFlag(args, "--evict-rate").value_or(0);
+        treeConfig.reshuffleReads = parseSizeFlag(args, "--reshuffle").value_or(0);
+        treeConfig.dummySlots = parseSizeFlag(args, "--dummy-slots").value_or(0);
+        treeConfig.stashLimit = parseSizeFlag(args, "--stash-limit").value_or(0);
+        treeConfig.stashWatermark = parseSizeFlag(args, "--stash-watermark").value_or(0);
+        std::optional<size_t> threadCount = parseSizeFlag(args, "--threads");
+        std::optional<size_t> batchSize = parseSizeFlag(args, "--batch");
+        std::optional<size_t> queueDepth = parseSizeFlag(args, "--queue-depth");
         bool debugMode = false;
         bool statsMode = false;
         bool ringFlag = false;
@@ -163,9 +382,24 @@ int main() {
                 std::cerr << "Invalid data size, bucket size or max tree size format." << std::endl;
                 continue;
             }
-            oramTrees = Forest(dataSize, bucketSize, maxSize);
+            try {
+                oramTrees = Forest(dataSize, bucketSize, maxSize, treeConfig, placement);
+            } catch (const std::exception& e) {
+                std::cerr << "Cannot build the forest: " << e.what() << std::endl;
+                continue;
+            }
             loaded = true;
             std::cout<< "New forest created with " << oramTrees.trees.size() << " trees." << std::endl;
+        } else if (args[0] == "convert") {
+            if (args.size() < 3) {
+                std::cerr << "Usage: convert <text_file> <binary_file> [ops]" << std::endl;
+                continue;
+            }
+            bool opFile = args.size() > 3 && args[3] == "ops";
+            std::optional<size_t> converted = opFile ? convertOpFile(args[1], args[2]) : convertStorageFile(args[1], args[2]);
+            if (converted.has_value()) {
+                std::cout << args[1] << " converted to " << args[2] << " with " << converted.value() << " entries." << std::endl;
+            }
         } else if (args[0] == "store") {
             if (args.size() < 2) {
                 std::cerr << "Usage: store <file_name>" << std::endl;
@@ -181,6 +415,40 @@ int main() {
                     continue;
                 }
             }
+            if (isStorageFile(fileName)) {
+                // binary storage: mapped as is and placed straight into the buckets, no ORAM access per entry
+                std::unique_ptr<StorageFile> storage;
+                try {
+                    storage = std::make_unique<StorageFile>(fileName);
+                    oramTrees = Forest(storage->size(), bucketSize, maxTreeSize, treeConfig, placement);
+                } catch (const std::exception& e) {
+                    std::cerr << "Cannot build the forest: " << e.what() << std::endl;
+                    continue;
+                }
+                auto startTime = std::chrono::high_resolution_clock::now();
+                oramTrees.bulkLoad(storage->records(), storage->size());
+                auto endTime = std::chrono::high_resolution_clock::now();
+                loaded = true;
+                if (!statsMode) {
+                    std::cout<<args[1]<< " bulk loaded with " << storage->size() << " entries." << std::endl;
+                }
+                if (debugMode) {
+                    std::cout<<oramTrees.toString() << std::endl;
+                }
+                if (statsMode) {
+                    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
+                    size_t totalStashSize = 0;
+                    for (const auto& tree : oramTrees.trees) {
+                        totalStashSize += tree.maxStashSize;
+                    }
+                    std::cout << "\n=== STATISTICS ===" << std::endl;
+                    std::cout << "Total execution time: " << duration.count() << " ms" << std::endl;
+                    std::cout << "Total max stash size: " << totalStashSize << " blocks" << std::endl;
+                    printCryptoStats(oramTrees, CryptoStats(), endTime - startTime);
+                    std::cout << "=================" << std::endl;
+                }
+                continue;
+            }
             std::ifstream inputFile(fileName);
             if (!inputFile) {
                 std::cerr << "Error opening file: " << fileName << std::endl;
@@ -195,7 +463,12 @@ int main() {
                     data.push_back({position, value});
                 }
             }
-            oramTrees = Forest(data.size(), bucketSize, maxTreeSize);
+            try {
+                oramTrees = Forest(data.size(), bucketSize, maxTreeSize, treeConfig, placement);
+            } catch (const std::exception& e) {
+                std::cerr << "Cannot build the forest: " << e.what() << std::endl;
+                continue;
+            }
             size_t position = 0;
 
             auto startTime = std::chrono::high_resolution_clock::now();
@@ -225,6 +498,7 @@ int main() {
                 std::cout << "\n=== STATISTICS ===" << std::endl;
                 std::cout << "Total execution time: " << duration.count() << " ms" << std::endl;
                 std::cout << "Total max stash size: " << totalStashSize << " blocks" << std::endl;
+                printCryptoStats(oramTrees, CryptoStats(), endTime - startTime);
                 std::cout << "=================" << std::endl;
             }
         } else if (args[0] == "operate") {
@@ -238,55 +512,116 @@ int main() {
             }
 
             std::string fileName = args[1];
-            std::ifstream inputFile(fileName);
-            if (!inputFile) {
-                std::cerr << "Error opening file: " << fileName << std::endl;
+            // the whole file is tokenized (or a binary trace mapped) up front, so the timed loop only runs accesses
+            std::unique_ptr<OpTrace> trace;
+            try {
+                trace = std::make_unique<OpTrace>(fileName);
+            } catch (const std::exception& e) {
+                std::cerr << "Error opening file: " << e.what() << std::endl;
                 continue;
             }
-            std::string line;
-            int opCount = 0;
-            auto startTime = std::chrono::high_resolution_clock::now();
-            while (std::getline(inputFile, line)) {
-                std::istringstream lineStream(line);
-                std::string operation;
-                if (lineStream >> operation) {
-                    if (operation == "R") {
-                        size_t position;
-                        if (lineStream >> position) {
-                            auto result = oramTrees.get(position, debugMode, randomReadRatio, ringFlag);
-                            if (!statsMode) {
-                                if (result.has_value()) {
-                                    std::cout << "READ pos " << position << ": " << result.value() << std::endl;
-                                } else {
-                                    std::cout << "READ pos " << position << ": NOT FOUND" << std::endl;
-                                }
-                            }
-                            opCount++;
+            size_t opCount = trace->size();
+            std::deque<PendingOperation> pending;
+            // in threaded mode keep a bounded window of requests in flight and report them in file order
+            auto drainPending = [&](size_t keep) {
+                while (pending.size() > keep) {
+                    PendingOperation& op = pending.front();
+                    std::optional<int> result = op.result.get();
+                    if (!statsMode) {
+                        if (!op.isRead) {
+                            std::cout << "WRITE pos " << op.position << " val " << op.value << ": DONE" << std::endl;
+                        } else if (result.has_value()) {
+                            std::cout << "READ pos " << op.position << ": " << result.value() << std::endl;
                         } else {
-                            std::cerr << "Invalid read operation format: " << line << std::endl;
+                            std::cout << "READ pos " << op.position << ": NOT FOUND" << std::endl;
                         }
-                    } else if (operation == "W") {
-                        size_t position;
-                        int value;
-                        if (lineStream >> position >> value) {
-                            oramTrees.put(position, value, debugMode, randomReadRatio);
-                            if (!statsMode) {
-                                std::cout << "WRITE pos " << position << " val " << value << ": DONE" << std::endl;
-                            }
-                            opCount++;
+                    }
+                    pending.pop_front();
+                }
+            };
+            std::vector<AccessRequest> batch;
+            // with --batch, requests are collected and served by one Forest::accessBatch per batch
+            auto flushBatch = [&]() {
+                oramTrees.accessBatch(batch, debugMode, randomReadRatio, ringFlag);
+                if (!statsMode) {
+                    for (const auto& request : batch) {
+                        if (request.op == WRITE) {
+                            std::cout << "WRITE pos " << request.position << " val " << request.value << ": DONE" << std::endl;
+                        } else if (request.result.has_value()) {
+                            std::cout << "READ pos " << request.position << ": " << request.result.value() << std::endl;
                         } else {
-                            std::cerr << "Invalid write operation format: " << line << std::endl;
+                            std::cout << "READ pos " << request.position << ": NOT FOUND" << std::endl;
+                        }
+                    }
+                }
+                batch.clear();
+            };
+            if (queueDepth.has_value() && !threadCount.has_value()) {
+                // the pipeline runs on the workers, one is enough to overlap with the caller
+                threadCount = 1;
+            }
+            if (threadCount.has_value()) {
+                debugMode = false;
+                if (batchSize.has_value()) {
+                    std::cerr << "--batch is ignored together with --threads." << std::endl;
+                    batchSize = std::nullopt;
+                }
+                oramTrees.startWorkers(threadCount.value(), queueDepth.value_or(1));
+            }
+            uint64_t windowsBefore = oramTrees.pipelineWindows;
+            uint64_t jobsBefore = oramTrees.pipelineJobs;
+            CryptoStats cryptoBefore = oramTrees.getCryptoStats();
+            BucketTransferStats transfersBefore = oramTrees.getTransferStats();
+            auto startTime = std::chrono::high_resolution_clock::now();
+            for (size_t i = 0; i < opCount; i++) {
+                const TraceOp& op = trace->ops()[i];
+                size_t position = op.position;
+                int value = op.value;
+                if (op.op == TRACE_READ) {
+                    if (threadCount.has_value()) {
+                        pending.push_back({true, position, 0, oramTrees.asyncGet(position, randomReadRatio, ringFlag)});
+                        drainPending(OPERATE_WINDOW);
+                    } else if (batchSize.has_value()) {
+                        batch.push_back({READ, position, 0, std::nullopt});
+                        if (batch.size() >= batchSize.value()) {
+                            flushBatch();
                         }
                     } else {
-                        std::cerr << "Unknown operation: " << operation << " in line: " << line << std::endl;
+                        auto result = oramTrees.get(position, debugMode, randomReadRatio, ringFlag);
+                        if (!statsMode) {
+                            if (result.has_value()) {
+                                std::cout << "READ pos " << position << ": " << result.value() << std::endl;
+                            } else {
+                                std::cout << "READ pos " << position << ": NOT FOUND" << std::endl;
+                            }
+                        }
                     }
-                    if (debugMode) {
-                        std::cout << oramTrees.toString() << std::endl;
+                } else {
+                    if (threadCount.has_value()) {
+                        pending.push_back({false, position, value, oramTrees.asyncPut(position, value, randomReadRatio, ringFlag)});
+                        drainPending(OPERATE_WINDOW);
+                    } else if (batchSize.has_value()) {
+                        batch.push_back({WRITE, position, value, std::nullopt});
+                        if (batch.size() >= batchSize.value()) {
+                            flushBatch();
+                        }
+                    } else {
+                        oramTrees.put(position, value, debugMode, randomReadRatio, ringFlag);
+                        if (!statsMode) {
+                            std::cout << "WRITE pos " << position << " val " << value << ": DONE" << std::endl;
+                        }
                     }
                 }
+                if (debugMode) {
+                    std::cout << oramTrees.toString() << std::endl;
+                }
+            }
+            drainPending(0);
+            if (!batch.empty()) {
+                flushBatch();
             }
             auto endTime = std::chrono::high_resolution_clock::now();
-            inputFile.close();
+            oramTrees.stopWorkers();
             std::cout << "Processed " << opCount << " operations from " << fileName << std::endl;
 
             if (statsMode) {
@@ -300,6 +635,15 @@ int main() {
                 std::cout << "Total max stash size: " << totalStashSize << " blocks" << std::endl;
                 std::cout << "Operations processed: " << opCount << std::endl;
                 std::cout << "Average time per operation: " << (opCount > 0 ? duration.count() / opCount : 0) << " ms" << std::endl;
+                printCryptoStats(oramTrees, cryptoBefore, endTime - startTime);
+                if (queueDepth.value_or(1) > 1 && oramTrees.pipelineWindows > windowsBefore) {
+                    std::cout << "Pipeline windows: " << oramTrees.pipelineWindows - windowsBefore << " (average depth "
+                              << double(oramTrees.pipelineJobs - jobsBefore) / (oramTrees.pipelineWindows - windowsBefore) << ")" << std::endl;
+                }
+                BucketTransferStats transfersAfter = oramTrees.getTransferStats();
+                if (transfersAfter.cacheBytes > 0 || transfersAfter.roundTrips > 0) {
+                    std::cout << formatTransferStats(transfersAfter, transfersBefore);
+                }
                 std::cout << "=================" << std::endl;
             }
 
@@ -363,6 +707,40 @@ int main() {
             oramTrees.put(position, value, debugMode, randomReadRatio, ringFlag);
             std::cout << "PUT pos " << position << " val " << value << ": DONE" << std::endl;
             std::cout<<"==========================="<<std::endl;
+        } else if (args[0] == "save") {
+            if (!loaded) {
+                std::cerr << "No data loaded. Please use the 'store' or 'newTree' command first." << std::endl;
+                continue;
+            }
+            if (args.size() < 2) {
+                std::cerr << "Usage: save <snapshot_file>" << std::endl;
+                continue;
+            }
+            auto startTime = std::chrono::high_resolution_clock::now();
+            try {
+                oramTrees.save(args[1]);
+            } catch (const std::exception& e) {
+                std::cerr << "Cannot save the forest: " << e.what() << std::endl;
+                continue;
+            }
+            auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - startTime);
+            std::cout << "Forest saved to " << args[1] << (statsMode ? " in " + std::to_string(duration.count()) + " ms." : ".") << std::endl;
+        } else if (args[0] == "load") {
+            if (args.size() < 2) {
+                std::cerr << "Usage: load <snapshot_file>" << std::endl;
+                continue;
+            }
+            auto startTime = std::chrono::high_resolution_clock::now();
+            try {
+                oramTrees = Forest::load(args[1]);
+            } catch (const std::exception& e) {
+                std::cerr << "Cannot load the forest: " << e.what() << std::endl;
+                continue;
+            }
+            auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - startTime);
+            loaded = true;
+            std::cout << "Forest loaded from " << args[1] << " with " << oramTrees.trees.size() << " trees"
+                      << (statsMode ? " in " + std::to_string(duration.count()) + " ms." : ".") << std::endl;
         } else if (args[0] == "print") {
             if (args.size() < 2) {
                 std::cerr << "Usage: print <ITEMS>"<<std::endl;
@@ -374,6 +752,18 @@ int main() {
                 }
             } else if (args[1] == "sizes") {
                 std::cout << oramTrees.getSizes() << std::endl;
+            } else if (args[1] == "posmap") {
+                std::cout << oramTrees.getPositionMapStats() << std::endl;
+            } else if (args[1] == "cache") {
+                std::cout << formatTransferStats(oramTrees.getTransferStats(), BucketTransferStats()) << std::endl;
+            } else if (args[1] == "stats") {
+                std::cout << oramTrees.getAccessStats().toString() << std::endl;
+            } else if (args[1] == "stats-json") {
+                if (args.size() < 3) {
+                    std::cout << oramTrees.getAccessStats().toJson() << std::endl;
+                } else {
+                    writeFileTo(args[2], oramTrees.getAccessStats().toJson() + "\n");
+                }
             } else if (args[1] == "posRange" ){
                 std::cout<< "Position range 1-" <<oramTrees.getPosRange()  - 1<< std::endl;
             } else {
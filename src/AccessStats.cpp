@@ -0,0 +1,93 @@
+#include "AccessStats.h"
+
+const char* accessPhaseName(AccessPhase phase) {
+    switch (phase) {
+        case PHASE_ROUTE:
+            return "route";
+        case PHASE_POSITION_MAP:
+            return "position_map";
+        case PHASE_PATH_READ:
+            return "path_read";
+        case PHASE_STASH_SEARCH:
+            return "stash_search";
+        case PHASE_EVICTION:
+            return "eviction";
+        default:
+            return "unknown";
+    }
+}
+
+void AccessStats::add(const AccessStats& other) {
+    accesses += other.accesses;
+    blocksRead += other.blocksRead;
+    blocksWritten += other.blocksWritten;
+    dummySlotsRead += other.dummySlotsRead;
+    stashLookups += other.stashLookups;
+    evictionChecks += other.evictionChecks;
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        phaseNanoseconds[i] += other.phaseNanoseconds[i];
+    }
+    for (int i = 0; i < STASH_HISTOGRAM_BUCKETS; i++) {
+        stashHistogram[i] += other.stashHistogram[i];
+    }
+}
+
+void AccessStats::recordStash(size_t stashSize) {
+    size_t bucket = stashSize == 0 ? 0 : 64 - __builtin_clzll(stashSize);
+    stashHistogram[bucket < STASH_HISTOGRAM_BUCKETS ? bucket : STASH_HISTOGRAM_BUCKETS - 1]++;
+}
+
+static std::string perAccess(uint64_t total, uint64_t accesses) {
+    return accesses > 0 ? std::to_string(static_cast<double>(total) / accesses) : "0";
+}
+
+std::string AccessStats::toString() const {
+    if (!ACCESS_STATS_ENABLED) {
+        return "Access instrumentation is compiled out, rebuild with make STATS=1 (-DORAM_STATS).\n";
+    }
+    std::string ret = "Accesses: " + std::to_string(accesses) + "\n";
+    ret += "Blocks read / written per access: " + perAccess(blocksRead, accesses) + " / " + perAccess(blocksWritten, accesses) + "\n";
+    ret += "Dummy slots read per access: " + perAccess(dummySlotsRead, accesses) + "\n";
+    ret += "Stash lookups: " + std::to_string(stashLookups) + ", eviction checks per access: " + perAccess(evictionChecks, accesses) + "\n";
+    uint64_t total = 0;
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        total += phaseNanoseconds[i];
+    }
+    ret += "Time per access by phase:\n";
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        ret += "  " + std::string(accessPhaseName(static_cast<AccessPhase>(i))) + ": " + perAccess(phaseNanoseconds[i], accesses) + " ns (" +
+               std::to_string(total > 0 ? 100.0 * phaseNanoseconds[i] / total : 0.0) + "%)\n";
+    }
+    ret += "Stash occupancy after an access (or a batch):\n";
+    for (int i = 0; i < STASH_HISTOGRAM_BUCKETS; i++) {
+        if (stashHistogram[i] == 0) {
+            continue;
+        }
+        std::string range = std::to_string(i == 0 ? 0 : size_t(1) << (i - 1));
+        if (i == STASH_HISTOGRAM_BUCKETS - 1) {
+            range += "+";
+        } else if (i > 1) {
+            range += "-" + std::to_string((size_t(1) << i) - 1);
+        }
+        ret += "  " + range + ": " + std::to_string(stashHistogram[i]) + "\n";
+    }
+    return ret;
+}
+
+std::string AccessStats::toJson() const {
+    std::string ret = "{\"enabled\":" + std::string(ACCESS_STATS_ENABLED ? "true" : "false") +
+                      ",\"accesses\":" + std::to_string(accesses) +
+                      ",\"blocks_read\":" + std::to_string(blocksRead) +
+                      ",\"blocks_written\":" + std::to_string(blocksWritten) +
+                      ",\"dummy_slots_read\":" + std::to_string(dummySlotsRead) +
+                      ",\"stash_lookups\":" + std::to_string(stashLookups) +
+                      ",\"eviction_checks\":" + std::to_string(evictionChecks) + ",\"phase_ns\":{";
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        ret += std::string(i > 0 ? "," : "") + "\"" + accessPhaseName(static_cast<AccessPhase>(i)) + "\":" + std::to_string(phaseNanoseconds[i]);
+    }
+    ret += "},\"stash_histogram\":[";
+    for (int i = 0; i < STASH_HISTOGRAM_BUCKETS; i++) {
+        ret += std::string(i > 0 ? "," : "") + std::to_string(stashHistogram[i]);
+    }
+    return ret + "]}";
+}
@@ -0,0 +1,74 @@
+#ifndef ACCESS_STATS_H
+#define ACCESS_STATS_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+// hot path instrumentation, compiled in with -DORAM_STATS (make STATS=1). Without it the macros below expand
+// to nothing, so the counters stay zero and the access path carries no extra work
+
+enum AccessPhase {
+    PHASE_ROUTE,        // forest position map, picking the tree
+    PHASE_POSITION_MAP, // label exchange, recursive maps run their own ORAM access here
+    PHASE_PATH_READ,    // staging and reading the path(s) into the stash
+    PHASE_STASH_SEARCH, // finding the target blocks in the stash
+    PHASE_EVICTION,     // write-back, including resealing
+    PHASE_COUNT
+};
+
+// stash occupancy after an access or a batch, bucket i holds sizes in [2^(i-1), 2^i), bucket 0 an empty stash
+#define STASH_HISTOGRAM_BUCKETS 20
+
+struct AccessStats {
+    uint64_t accesses = 0;
+    // real blocks moved from buckets to the stash and back
+    uint64_t blocksRead = 0;
+    uint64_t blocksWritten = 0;
+    // free slots of the buckets on the read paths, implicit dummies the server still transfers
+    uint64_t dummySlotsRead = 0;
+    uint64_t stashLookups = 0;
+    // blocks eviction tested against a node's leaf range
+    uint64_t evictionChecks = 0;
+    uint64_t phaseNanoseconds[PHASE_COUNT] = {};
+    uint64_t stashHistogram[STASH_HISTOGRAM_BUCKETS] = {};
+
+    void add(const AccessStats& other);
+    void recordStash(size_t stashSize);
+    std::string toString() const;
+    // one flat JSON object, field names as above
+    std::string toJson() const;
+};
+
+const char* accessPhaseName(AccessPhase phase);
+
+#ifdef ORAM_STATS
+#define ACCESS_STATS_ENABLED true
+
+// adds the scope's wall time to one phase counter
+class PhaseTimer {
+public:
+    explicit PhaseTimer(uint64_t& slot) : slot(slot), startTime(std::chrono::steady_clock::now()) {}
+    ~PhaseTimer() {
+        slot += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+    }
+
+private:
+    uint64_t& slot;
+    std::chrono::steady_clock::time_point startTime;
+};
+
+#define STATS_CONCAT_INNER(a, b) a##b
+#define STATS_CONCAT(a, b) STATS_CONCAT_INNER(a, b)
+#define STATS_COUNT(stats, field, amount) ((stats).field += (amount))
+#define STATS_PHASE(stats, phase) PhaseTimer STATS_CONCAT(phaseTimer, __LINE__)((stats).phaseNanoseconds[phase])
+#define STATS_STASH(stats, size) (stats).recordStash(size)
+#else
+#define ACCESS_STATS_ENABLED false
+#define STATS_COUNT(stats, field, amount) ((void)0)
+#define STATS_PHASE(stats, phase) ((void)0)
+#define STATS_STASH(stats, size) ((void)0)
+#endif
+
+#endif // ACCESS_STATS_H
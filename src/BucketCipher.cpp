@@ -0,0 +1,283 @@
+#include "BucketCipher.h"
+#include "chacha.h"
+
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+
+#ifdef HAVE_OPENSSL
+#include <openssl/evp.h>
+#endif
+
+std::optional<CipherKind> parseCipherKind(const std::string& name) {
+    if (name == "none") {
+        return CipherKind::NONE;
+    }
+    if (name == "chacha") {
+        return CipherKind::CHACHA20_POLY1305;
+    }
+    if (name == "aes") {
+        return CipherKind::AES_256_GCM;
+    }
+    return std::nullopt;
+}
+
+std::string cipherKindName(CipherKind kind) {
+    switch (kind) {
+        case CipherKind::CHACHA20_POLY1305:
+            return "ChaCha20-Poly1305";
+        case CipherKind::AES_256_GCM:
+            return "AES-256-GCM";
+        default:
+            return "none";
+    }
+}
+
+bool cipherAvailable(CipherKind kind) {
+#ifdef HAVE_OPENSSL
+    (void)kind;
+    return true;
+#else
+    return kind != CipherKind::AES_256_GCM;
+#endif
+}
+
+static inline void storeNodeID(uint8_t aad[8], size_t nodeID) {
+    for (int i = 0; i < 8; i++) {
+        aad[i] = static_cast<uint8_t>(static_cast<uint64_t>(nodeID) >> (8 * i));
+    }
+}
+
+BucketCipher::BucketCipher(CipherKind kind, size_t plainSize, const uint8_t* savedKey)
+    : kind(kind), plainSize(plainSize), nonceCounter(0), aesSealContext(nullptr), aesOpenContext(nullptr) {
+    if (!cipherAvailable(kind)) {
+        throw std::runtime_error(cipherKindName(kind) + " needs a build with OpenSSL");
+    }
+    // keys come from the OS rather than the seedable access RNG, a replayed seed must not replay the key
+    std::random_device device;
+    for (int i = 0; i < 8; i++) {
+        if (savedKey != nullptr) {
+            keyWords[i] = 0;
+            for (int j = 0; j < 4; j++) {
+                keyWords[i] |= static_cast<uint32_t>(savedKey[4 * i + j]) << (8 * j);
+            }
+        } else {
+            keyWords[i] = device();
+        }
+        for (int j = 0; j < 4; j++) {
+            key[4 * i + j] = static_cast<uint8_t>(keyWords[i] >> (8 * j));
+        }
+    }
+    noncePrefix = device();
+#ifdef HAVE_OPENSSL
+    if (kind == CipherKind::AES_256_GCM) {
+        EVP_CIPHER_CTX* sealContext = EVP_CIPHER_CTX_new();
+        EVP_CIPHER_CTX* openContext = EVP_CIPHER_CTX_new();
+        if (sealContext == nullptr || openContext == nullptr ||
+            EVP_EncryptInit_ex(sealContext, EVP_aes_256_gcm(), nullptr, key, nullptr) != 1 ||
+            EVP_DecryptInit_ex(openContext, EVP_aes_256_gcm(), nullptr, key, nullptr) != 1) {
+            // the destructor does not run for a throwing constructor
+            EVP_CIPHER_CTX_free(sealContext);
+            EVP_CIPHER_CTX_free(openContext);
+            std::memset(key, 0, sizeof(key));
+            std::memset(keyWords, 0, sizeof(keyWords));
+            throw std::runtime_error("could not set up the AES-256-GCM contexts");
+        }
+        aesSealContext = sealContext;
+        aesOpenContext = openContext;
+    }
+#endif
+}
+
+BucketCipher::~BucketCipher() {
+#ifdef HAVE_OPENSSL
+    EVP_CIPHER_CTX_free(static_cast<EVP_CIPHER_CTX*>(aesSealContext));
+    EVP_CIPHER_CTX_free(static_cast<EVP_CIPHER_CTX*>(aesOpenContext));
+#endif
+    std::memset(key, 0, sizeof(key));
+    std::memset(keyWords, 0, sizeof(keyWords));
+}
+
+CipherKind BucketCipher::getKind() const {
+    return kind;
+}
+
+size_t BucketCipher::sealedSize() const {
+    return SEALED_PREFIX_SIZE + plainSize + SEALED_TAG_SIZE;
+}
+
+const uint8_t* BucketCipher::keyBytes() const {
+    return key;
+}
+
+// 32 random bits fixed per key and a 64 bit write counter, so a nonce never repeats under one key
+void BucketCipher::nextNonce(uint8_t* nonce) {
+    nonceCounter++;
+    for (int i = 0; i < 4; i++) {
+        nonce[i] = static_cast<uint8_t>(noncePrefix >> (8 * i));
+    }
+    for (int i = 0; i < 8; i++) {
+        nonce[4 + i] = static_cast<uint8_t>(nonceCounter >> (8 * i));
+    }
+    std::memset(nonce + SEALED_NONCE_SIZE, 0, SEALED_PREFIX_SIZE - SEALED_NONCE_SIZE);
+}
+
+void BucketCipher::sealBatch(uint8_t* const* plains, uint8_t* const* sealed, const size_t* nodeIDs, size_t count) {
+    auto startTime = std::chrono::steady_clock::now();
+    if (kind == CipherKind::AES_256_GCM) {
+        aesSeal(plains, sealed, nodeIDs, count);
+    } else {
+        chachaSeal(plains, sealed, nodeIDs, count);
+    }
+    sealedBuckets += count;
+    nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+bool BucketCipher::openBatch(const uint8_t* const* sealed, uint8_t* const* plains, const size_t* nodeIDs, size_t count) {
+    auto startTime = std::chrono::steady_clock::now();
+    bool valid;
+    if (kind == CipherKind::AES_256_GCM) {
+        valid = aesOpen(sealed, plains, nodeIDs, count);
+    } else {
+        valid = chachaOpen(sealed, plains, nodeIDs, count);
+    }
+    openedBuckets += count;
+    nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+    return valid;
+}
+
+// every record needs block 0 for its Poly1305 key and blocks 1.. for the message. All of them, across all
+// records, go through chacha20Blocks together so a path of L + 1 buckets fills whole vector lanes
+void BucketCipher::reserve(size_t count) {
+    if (kind != CipherKind::CHACHA20_POLY1305) {
+        return;
+    }
+    size_t total = (1 + (plainSize + CHACHA_BLOCK_BYTES - 1) / CHACHA_BLOCK_BYTES) * count;
+    counters.reserve(total);
+    nonces.reserve(total * CHACHA_NONCE_WORDS);
+    keystream.reserve(total * CHACHA_BLOCK_WORDS);
+}
+
+void BucketCipher::chachaKeystream(const uint8_t* const* nonceSources, size_t count) {
+    size_t perRecord = 1 + (plainSize + CHACHA_BLOCK_BYTES - 1) / CHACHA_BLOCK_BYTES;
+    size_t total = perRecord * count;
+    counters.resize(total);
+    nonces.resize(total * CHACHA_NONCE_WORDS);
+    keystream.resize(total * CHACHA_BLOCK_WORDS);
+    for (size_t r = 0; r < count; r++) {
+        uint32_t nonceWords[CHACHA_NONCE_WORDS];
+        std::memcpy(nonceWords, nonceSources[r], SEALED_NONCE_SIZE);
+        for (size_t b = 0; b < perRecord; b++) {
+            size_t index = r * perRecord + b;
+            counters[index] = static_cast<uint32_t>(b);
+            std::memcpy(&nonces[index * CHACHA_NONCE_WORDS], nonceWords, SEALED_NONCE_SIZE);
+        }
+    }
+    chacha20Blocks(keyWords, counters.data(), nonces.data(), keystream.data(), total);
+}
+
+// keystream words are consumed in memory order, which is the RFC byte order on the little endian hosts we build for
+static inline void xorBytes(const uint8_t* in, const uint8_t* stream, uint8_t* out, size_t length) {
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t a, b;
+        std::memcpy(&a, in + i, 8);
+        std::memcpy(&b, stream + i, 8);
+        a ^= b;
+        std::memcpy(out + i, &a, 8);
+    }
+    for (; i < length; i++) {
+        out[i] = in[i] ^ stream[i];
+    }
+}
+
+void BucketCipher::chachaSeal(uint8_t* const* plains, uint8_t* const* sealed, const size_t* nodeIDs, size_t count) {
+    for (size_t r = 0; r < count; r++) {
+        nextNonce(sealed[r]);
+    }
+    chachaKeystream(sealed, count);
+    size_t perRecord = 1 + (plainSize + CHACHA_BLOCK_BYTES - 1) / CHACHA_BLOCK_BYTES;
+    for (size_t r = 0; r < count; r++) {
+        const uint8_t* stream = reinterpret_cast<const uint8_t*>(&keystream[r * perRecord * CHACHA_BLOCK_WORDS]);
+        uint8_t* cipher = sealed[r] + SEALED_PREFIX_SIZE;
+        xorBytes(plains[r], stream + CHACHA_BLOCK_BYTES, cipher, plainSize);
+        uint8_t aad[8];
+        storeNodeID(aad, nodeIDs[r]);
+        chacha20Poly1305Tag(stream, aad, sizeof(aad), cipher, plainSize, cipher + plainSize);
+    }
+}
+
+bool BucketCipher::chachaOpen(const uint8_t* const* sealed, uint8_t* const* plains, const size_t* nodeIDs, size_t count) {
+    chachaKeystream(sealed, count);
+    size_t perRecord = 1 + (plainSize + CHACHA_BLOCK_BYTES - 1) / CHACHA_BLOCK_BYTES;
+    bool valid = true;
+    for (size_t r = 0; r < count; r++) {
+        const uint8_t* stream = reinterpret_cast<const uint8_t*>(&keystream[r * perRecord * CHACHA_BLOCK_WORDS]);
+        const uint8_t* cipher = sealed[r] + SEALED_PREFIX_SIZE;
+        uint8_t aad[8];
+        uint8_t expected[SEALED_TAG_SIZE];
+        storeNodeID(aad, nodeIDs[r]);
+        chacha20Poly1305Tag(stream, aad, sizeof(aad), cipher, plainSize, expected);
+        uint8_t diff = 0;
+        for (int i = 0; i < SEALED_TAG_SIZE; i++) {
+            diff |= expected[i] ^ cipher[plainSize + i];
+        }
+        if (diff != 0) {
+            valid = false;
+            continue;
+        }
+        xorBytes(cipher, stream + CHACHA_BLOCK_BYTES, plains[r], plainSize);
+    }
+    return valid;
+}
+
+#ifdef HAVE_OPENSSL
+// OpenSSL drives AES-NI and PCLMULQDQ itself, the contexts keep their key schedule across the whole path
+void BucketCipher::aesSeal(uint8_t* const* plains, uint8_t* const* sealed, const size_t* nodeIDs, size_t count) {
+    EVP_CIPHER_CTX* context = static_cast<EVP_CIPHER_CTX*>(aesSealContext);
+    for (size_t r = 0; r < count; r++) {
+        nextNonce(sealed[r]);
+        uint8_t aad[8];
+        storeNodeID(aad, nodeIDs[r]);
+        uint8_t* cipher = sealed[r] + SEALED_PREFIX_SIZE;
+        int length = 0;
+        // a record sealed halfway would only fail authentication on its next read, blaming the store
+        if (EVP_EncryptInit_ex(context, nullptr, nullptr, nullptr, sealed[r]) != 1 ||
+            EVP_EncryptUpdate(context, nullptr, &length, aad, sizeof(aad)) != 1 ||
+            EVP_EncryptUpdate(context, cipher, &length, plains[r], static_cast<int>(plainSize)) != 1 ||
+            EVP_EncryptFinal_ex(context, cipher + length, &length) != 1 ||
+            EVP_CIPHER_CTX_ctrl(context, EVP_CTRL_GCM_GET_TAG, SEALED_TAG_SIZE, cipher + plainSize) != 1) {
+            throw std::runtime_error("AES-256-GCM failed to seal a bucket");
+        }
+    }
+}
+
+bool BucketCipher::aesOpen(const uint8_t* const* sealed, uint8_t* const* plains, const size_t* nodeIDs, size_t count) {
+    EVP_CIPHER_CTX* context = static_cast<EVP_CIPHER_CTX*>(aesOpenContext);
+    bool valid = true;
+    for (size_t r = 0; r < count; r++) {
+        uint8_t aad[8];
+        storeNodeID(aad, nodeIDs[r]);
+        const uint8_t* cipher = sealed[r] + SEALED_PREFIX_SIZE;
+        int length = 0;
+        // only the final tag check speaks about the record, anything failing before it is a local error
+        if (EVP_DecryptInit_ex(context, nullptr, nullptr, nullptr, sealed[r]) != 1 ||
+            EVP_DecryptUpdate(context, nullptr, &length, aad, sizeof(aad)) != 1 ||
+            EVP_DecryptUpdate(context, plains[r], &length, cipher, static_cast<int>(plainSize)) != 1 ||
+            EVP_CIPHER_CTX_ctrl(context, EVP_CTRL_GCM_SET_TAG, SEALED_TAG_SIZE, const_cast<uint8_t*>(cipher + plainSize)) != 1) {
+            throw std::runtime_error("AES-256-GCM failed to open a bucket");
+        }
+        if (EVP_DecryptFinal_ex(context, plains[r] + length, &length) <= 0) {
+            valid = false;
+        }
+    }
+    return valid;
+}
+#else
+void BucketCipher::aesSeal(uint8_t* const*, uint8_t* const*, const size_t*, size_t) {}
+
+bool BucketCipher::aesOpen(const uint8_t* const*, uint8_t* const*, const size_t*, size_t) {
+    return false;
+}
+#endif
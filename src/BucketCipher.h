@@ -0,0 +1,90 @@
+#ifndef BUCKET_CIPHER_H
+#define BUCKET_CIPHER_H
+
+#include <vector>
+#include <string>
+#include <optional>
+#include <cstdint>
+#include <cstddef>
+
+// a plaintext bucket record is this header (the occupancy count, the reads since the bucket was last written,
+// then the ring bucket mask of slots read since then) followed by the blocks
+#define BUCKET_HEADER_SIZE 16
+#define BUCKET_READS_OFFSET 4
+#define BUCKET_USED_SLOTS_OFFSET 8
+// sealed record: nonce padded to 16 bytes, ciphertext of the plaintext record, authentication tag
+#define SEALED_NONCE_SIZE 12
+#define SEALED_PREFIX_SIZE 16
+#define SEALED_TAG_SIZE 16
+#define BUCKET_KEY_SIZE 32
+
+// totals over every cipher a tree and its map trees own
+struct CryptoStats {
+    uint64_t sealedBuckets = 0;
+    uint64_t openedBuckets = 0;
+    uint64_t nanoseconds = 0;
+};
+
+enum class CipherKind {
+    NONE,
+    CHACHA20_POLY1305,
+    AES_256_GCM
+};
+
+std::optional<CipherKind> parseCipherKind(const std::string& name);
+std::string cipherKindName(CipherKind kind);
+// AES-256-GCM needs the OpenSSL build, ChaCha20-Poly1305 is always compiled in
+bool cipherAvailable(CipherKind kind);
+
+// seals fixed-size bucket records under a per-tree random key. Every seal draws a fresh nonce from a
+// counter, and the node id is bound as associated data so the server cannot swap buckets around.
+// The batch calls take a whole path (or a union of paths) so the keystream is produced in one vector pass.
+class BucketCipher {
+public:
+    // savedKey takes over the key of a snapshot. The nonce prefix is drawn fresh either way, so two sessions
+    // loaded from one snapshot never seal under the same nonce. Throws runtime_error when kind is not built in or
+    // its cipher contexts cannot be set up
+    BucketCipher(CipherKind kind, size_t plainSize, const uint8_t* savedKey = nullptr);
+    BucketCipher(const BucketCipher&) = delete;
+    BucketCipher& operator=(const BucketCipher&) = delete;
+    ~BucketCipher();
+
+    CipherKind getKind() const;
+    size_t sealedSize() const;
+    // BUCKET_KEY_SIZE bytes, only for writing snapshots
+    const uint8_t* keyBytes() const;
+    // throws runtime_error when the cipher library fails, never leaving a record that cannot be opened
+    void sealBatch(uint8_t* const* plains, uint8_t* const* sealed, const size_t* nodeIDs, size_t count);
+    // returns false when any record fails authentication, throws runtime_error when the cipher library fails
+    bool openBatch(const uint8_t* const* sealed, uint8_t* const* plains, const size_t* nodeIDs, size_t count);
+    // sizes the keystream scratch for batches of up to count records, so they never allocate
+    void reserve(size_t count);
+
+    uint64_t sealedBuckets = 0;
+    uint64_t openedBuckets = 0;
+    uint64_t nanoseconds = 0;
+
+private:
+    CipherKind kind;
+    size_t plainSize;
+    uint8_t key[BUCKET_KEY_SIZE];
+    uint32_t keyWords[8];
+    uint32_t noncePrefix;
+    uint64_t nonceCounter;
+    // keystream scratch for the batched ChaCha20 path
+    std::vector<uint32_t> counters;
+    std::vector<uint32_t> nonces;
+    std::vector<uint32_t> keystream;
+    // EVP_CIPHER_CTX pointers keyed once, kept opaque so OpenSSL headers stay out of the tree
+    void* aesSealContext;
+    void* aesOpenContext;
+
+    void nextNonce(uint8_t* nonce);
+    void chachaKeystream(const uint8_t* const* nonceSources, size_t count);
+    void chachaSeal(uint8_t* const* plains, uint8_t* const* sealed, const size_t* nodeIDs, size_t count);
+    bool chachaOpen(const uint8_t* const* sealed, uint8_t* const* plains, const size_t* nodeIDs, size_t count);
+    void aesSeal(uint8_t* const* plains, uint8_t* const* sealed, const size_t* nodeIDs, size_t count);
+    bool aesOpen(const uint8_t* const* sealed, uint8_t* const* plains, const size_t* nodeIDs, size_t count);
+};
+
+#endif // BUCKET_CIPHER_H
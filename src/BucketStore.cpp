@@ -0,0 +1,161 @@
+#include "BucketStore.h"
+
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#define STORE_FILE_MAGIC "PORAMBKT"
+#define STORE_FILE_VERSION 1
+
+// first bytes of the header page of a bucket file
+struct StoreFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t recordSize;
+    uint64_t recordStride;
+    uint64_t recordCount;
+    uint64_t firstRecord;
+};
+
+void BucketStore::readRecords(const size_t* nodeIDs, size_t nodeCount, uint8_t* out) {
+    for (size_t i = 0; i < nodeCount; i++) {
+        std::memcpy(out + i * size, record(nodeIDs[i]), size);
+    }
+}
+
+void BucketStore::writeRecords(const size_t* nodeIDs, size_t nodeCount, const uint8_t* in) {
+    for (size_t i = 0; i < nodeCount; i++) {
+        std::memcpy(record(nodeIDs[i]), in + i * size, size);
+    }
+}
+
+MemoryBucketStore::MemoryBucketStore(size_t firstRecord, size_t recordCount, size_t recordSize) {
+    first = firstRecord;
+    size = recordSize;
+    count = recordCount;
+    // every record starts a cache line, so a bucket never shares its first line with the tail of another
+    stride = (recordSize + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+    base = static_cast<uint8_t*>(::operator new(recordCount * stride, std::align_val_t(CACHE_LINE_SIZE)));
+    std::memset(base, 0, recordCount * stride);
+}
+
+MemoryBucketStore::~MemoryBucketStore() {
+    ::operator delete(base, std::align_val_t(CACHE_LINE_SIZE));
+}
+
+std::string MemoryBucketStore::describe() const {
+    return "memory, " + std::to_string(count) + " records of " + std::to_string(size) + " bytes at a " + std::to_string(stride) +
+           " byte stride";
+}
+
+// power of two up to a page so records pack pages exactly, whole pages beyond that
+static size_t fileStride(size_t recordSize) {
+    if (recordSize >= STORE_PAGE_SIZE) {
+        return (recordSize + STORE_PAGE_SIZE - 1) / STORE_PAGE_SIZE * STORE_PAGE_SIZE;
+    }
+    size_t stride = 16;
+    while (stride < recordSize) {
+        stride <<= 1;
+    }
+    return stride;
+}
+
+FileBucketStore::FileBucketStore(const std::string& path, size_t firstRecord, size_t recordCount, size_t recordSize) : path(path) {
+    first = firstRecord;
+    size = recordSize;
+    count = recordCount;
+    stride = fileStride(recordSize);
+    mappedBytes = STORE_PAGE_SIZE + recordCount * stride;
+    uint8_t* mapped = nullptr;
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error("cannot create bucket file " + path);
+    }
+    LARGE_INTEGER length;
+    length.QuadPart = static_cast<LONGLONG>(mappedBytes);
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, length.HighPart, length.LowPart, nullptr);
+    if (mapping != nullptr) {
+        mapped = static_cast<uint8_t*>(MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, mappedBytes));
+    }
+    if (mapped == nullptr) {
+        if (mapping != nullptr) {
+            CloseHandle(mapping);
+        }
+        CloseHandle(file);
+        throw std::runtime_error("cannot map bucket file " + path);
+    }
+    fileHandle = file;
+    mappingHandle = mapping;
+#else
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        throw std::runtime_error("cannot create bucket file " + path);
+    }
+    // sparse: untouched records cost no disk and read back as zero
+    if (::ftruncate(fd, static_cast<off_t>(mappedBytes)) != 0) {
+        ::close(fd);
+        throw std::runtime_error("cannot size bucket file " + path);
+    }
+    void* region = ::mmap(nullptr, mappedBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (region == MAP_FAILED) {
+        ::close(fd);
+        throw std::runtime_error("cannot map bucket file " + path);
+    }
+    mapped = static_cast<uint8_t*>(region);
+    // paths are random, read-ahead past the requested page would only evict the hot top levels
+    ::madvise(mapped + STORE_PAGE_SIZE, mappedBytes - STORE_PAGE_SIZE, MADV_RANDOM);
+#endif
+    StoreFileHeader header = {};
+    std::memcpy(header.magic, STORE_FILE_MAGIC, sizeof(header.magic));
+    header.version = STORE_FILE_VERSION;
+    header.recordSize = recordSize;
+    header.recordStride = stride;
+    header.recordCount = recordCount;
+    header.firstRecord = firstRecord;
+    std::memcpy(mapped, &header, sizeof(header));
+    base = mapped + STORE_PAGE_SIZE;
+}
+
+FileBucketStore::~FileBucketStore() {
+    sync();
+    uint8_t* mapped = base - STORE_PAGE_SIZE;
+#ifdef _WIN32
+    UnmapViewOfFile(mapped);
+    CloseHandle(static_cast<HANDLE>(mappingHandle));
+    CloseHandle(static_cast<HANDLE>(fileHandle));
+#else
+    ::munmap(mapped, mappedBytes);
+    ::close(fd);
+#endif
+}
+
+void FileBucketStore::sync() {
+    uint8_t* mapped = base - STORE_PAGE_SIZE;
+#ifdef _WIN32
+    FlushViewOfFile(mapped, mappedBytes);
+#else
+    ::msync(mapped, mappedBytes, MS_ASYNC);
+#endif
+}
+
+std::string FileBucketStore::describe() const {
+    return "file " + path + ", " + std::to_string(count) + " records of " + std::to_string(size) +
+           " bytes at a " + std::to_string(stride) + " byte stride";
+}
+
+std::unique_ptr<BucketStore> makeBucketStore(const std::string& path, size_t firstRecord, size_t recordCount, size_t recordSize) {
+    if (path.empty()) {
+        return std::make_unique<MemoryBucketStore>(firstRecord, recordCount, recordSize);
+    }
+    return std::make_unique<FileBucketStore>(path, firstRecord, recordCount, recordSize);
+}
@@ -0,0 +1,128 @@
+#ifndef BUCKET_STORE_H
+#define BUCKET_STORE_H
+
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+#include "AlignedAllocator.h"
+
+// the file layout is fixed at 4 KiB pages whatever the host page size is
+#define STORE_PAGE_SIZE 4096
+
+// bucket traffic of a tree and its map trees, split by whether a bucket came from the store or the
+// client's tree-top cache. accesses counts the data tree's accesses only, so per access figures include the map trees
+struct BucketTransferStats {
+    uint64_t accesses = 0;
+    uint64_t storeBuckets = 0;
+    uint64_t cachedBuckets = 0;
+    // single slots of ring buckets read from the store, storeBytes includes them
+    uint64_t storeSlots = 0;
+    uint64_t storeBytes = 0;
+    uint64_t savedBytes = 0;
+    uint64_t cacheBytes = 0;
+    // remote stores only: requests that waited for the server, and the bytes both ways including framing
+    uint64_t roundTrips = 0;
+    uint64_t wireBytes = 0;
+};
+
+// fixed-width records for the node ids [firstRecord, firstRecord + recordCount), ids below that belong to the
+// client's tree-top cache. Record access is a plain pointer computation so the tree can view a bucket in place,
+// local backends only differ in where the bytes live. A remote store has no local records, it is only used through
+// readRecords and writeRecords
+class BucketStore {
+public:
+    virtual ~BucketStore() = default;
+
+    uint8_t* record(size_t nodeID) {
+        return base + (nodeID - first) * stride;
+    }
+    const uint8_t* record(size_t nodeID) const {
+        return base + (nodeID - first) * stride;
+    }
+    bool holds(size_t nodeID) const {
+        return nodeID >= first;
+    }
+    size_t firstRecord() const {
+        return first;
+    }
+    size_t recordSize() const {
+        return size;
+    }
+    size_t recordCount() const {
+        return count;
+    }
+    // bytes between consecutive records, at least recordSize
+    size_t recordStride() const {
+        return stride;
+    }
+    // asks for every cache line of the records of a path before they are read
+    void prefetch(const size_t* nodeIDs, size_t nodeCount) {
+        for (size_t i = 0; i < nodeCount; i++) {
+            if (holds(nodeIDs[i])) {
+                for (size_t offset = 0; offset < size; offset += CACHE_LINE_SIZE) {
+                    __builtin_prefetch(record(nodeIDs[i]) + offset, 1);
+                }
+            }
+        }
+    }
+    // false when record() is unusable and the records have to be copied in and out
+    virtual bool inPlace() const {
+        return true;
+    }
+    // copies the records of nodeIDs to out back to back, recordSize bytes each
+    virtual void readRecords(const size_t* nodeIDs, size_t nodeCount, uint8_t* out);
+    // overwrites the records of nodeIDs from in, laid out like readRecords' output
+    virtual void writeRecords(const size_t* nodeIDs, size_t nodeCount, const uint8_t* in);
+    // pushes written records to the backing medium
+    virtual void sync() {}
+    virtual uint64_t roundTrips() const {
+        return 0;
+    }
+    virtual uint64_t wireBytes() const {
+        return 0;
+    }
+    virtual std::string describe() const = 0;
+
+protected:
+    uint8_t* base = nullptr;
+    size_t first = 0;
+    size_t size = 0;
+    size_t count = 0;
+    size_t stride = 0;
+};
+
+// zero-initialised records in one cache line aligned allocation, each record starting on a cache line
+class MemoryBucketStore : public BucketStore {
+public:
+    MemoryBucketStore(size_t firstRecord, size_t recordCount, size_t recordSize);
+    ~MemoryBucketStore() override;
+    std::string describe() const override;
+};
+
+// records in a memory-mapped file. The first page is a header describing the geometry, records follow
+// at a power of two stride (or whole pages) so no record straddles a page and a path read touches
+// exactly L + 1 pages. A new file is sparse, so its records read as zero until written.
+class FileBucketStore : public BucketStore {
+public:
+    FileBucketStore(const std::string& path, size_t firstRecord, size_t recordCount, size_t recordSize);
+    ~FileBucketStore() override;
+    void sync() override;
+    std::string describe() const override;
+
+private:
+    std::string path;
+    size_t mappedBytes;
+#ifdef _WIN32
+    void* fileHandle;
+    void* mappingHandle;
+#else
+    int fd;
+#endif
+};
+
+// an empty path keeps the buckets in memory, otherwise they go to a file at path
+std::unique_ptr<BucketStore> makeBucketStore(const std::string& path, size_t firstRecord, size_t recordCount, size_t recordSize);
+
+#endif // BUCKET_STORE_H
@@ -0,0 +1,123 @@
+#ifndef FLAT_INDEX_H
+#define FLAT_INDEX_H
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+// open addressing map from size_t keys to size_t values with linear probing,
+// sized for a few hundred live entries that are looked up on every access
+class FlatIndex {
+public:
+    static constexpr size_t NOT_FOUND = SIZE_MAX;
+
+    explicit FlatIndex(size_t expected = 64) {
+        size_t capacity = 16;
+        while (capacity < expected * 2) {
+            capacity <<= 1;
+        }
+        keys = std::vector<size_t>(capacity, EMPTY);
+        values = std::vector<size_t>(capacity);
+        count = 0;
+    }
+
+    size_t find(size_t key) const {
+        size_t mask = keys.size() - 1;
+        for (size_t i = hash(key) & mask; ; i = (i + 1) & mask) {
+            if (keys[i] == key) {
+                return values[i];
+            }
+            if (keys[i] == EMPTY) {
+                return NOT_FOUND;
+            }
+        }
+    }
+
+    // inserts or overwrites
+    void insert(size_t key, size_t value) {
+        if ((count + 1) * 2 > keys.size()) {
+            grow();
+        }
+        size_t mask = keys.size() - 1;
+        size_t i = hash(key) & mask;
+        while (keys[i] != EMPTY && keys[i] != key) {
+            i = (i + 1) & mask;
+        }
+        if (keys[i] == EMPTY) {
+            count++;
+        }
+        keys[i] = key;
+        values[i] = value;
+    }
+
+    // backward shift deletion, so lookups never need tombstones
+    void erase(size_t key) {
+        size_t mask = keys.size() - 1;
+        size_t i = hash(key) & mask;
+        while (keys[i] != key) {
+            if (keys[i] == EMPTY) {
+                return;
+            }
+            i = (i + 1) & mask;
+        }
+        count--;
+        size_t hole = i;
+        for (size_t j = (hole + 1) & mask; keys[j] != EMPTY; j = (j + 1) & mask) {
+            size_t home = hash(keys[j]) & mask;
+            // move j back into the hole unless its home slot lies cyclically in (hole, j]
+            if (((j - home) & mask) >= ((j - hole) & mask)) {
+                keys[hole] = keys[j];
+                values[hole] = values[j];
+                hole = j;
+            }
+        }
+        keys[hole] = EMPTY;
+    }
+
+    // room for expected entries, so inserting up to that many never rehashes
+    void reserve(size_t expected) {
+        while (expected * 2 > keys.size()) {
+            grow();
+        }
+    }
+
+    void clear() {
+        if (count > 0) {
+            std::fill(keys.begin(), keys.end(), EMPTY);
+            count = 0;
+        }
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+private:
+    static constexpr size_t EMPTY = SIZE_MAX;
+    std::vector<size_t> keys;
+    std::vector<size_t> values;
+    size_t count;
+
+    static size_t hash(size_t key) {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdULL;
+        key ^= key >> 33;
+        return key;
+    }
+
+    void grow() {
+        std::vector<size_t> oldKeys = std::move(keys);
+        std::vector<size_t> oldValues = std::move(values);
+        keys = std::vector<size_t>(oldKeys.size() * 2, EMPTY);
+        values = std::vector<size_t>(oldKeys.size() * 2);
+        count = 0;
+        for (size_t i = 0; i < oldKeys.size(); i++) {
+            if (oldKeys[i] != EMPTY) {
+                insert(oldKeys[i], oldValues[i]);
+            }
+        }
+    }
+};
+
+#endif // FLAT_INDEX_H
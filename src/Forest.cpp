@@ -1,61 +1,437 @@
 #include "Forest.h"
+#include "rgen.h"
 
-Forest::Forest(size_t dataSize, size_t bucketSize, size_t maxSize): positionMap(dataSize + 1, std::nullopt) {
+static inline uint64_t mix64(uint64_t value) {
+    // splitmix64 finaliser
+    value ^= value >> 30;
+    value *= 0xbf58476d1ce4e5b9ULL;
+    value ^= value >> 27;
+    value *= 0x94d049bb133111ebULL;
+    value ^= value >> 31;
+    return value;
+}
+
+#define PLACEMENT_ROUNDS 4
+
+ForestPlacement::ForestPlacement(PlacementKind kind, size_t positionCount, size_t treeCount, uint64_t key)
+    : kind(kind), positionCount(positionCount), treeCount(treeCount), key(key) {
+    perTree = (positionCount + treeCount - 1) / treeCount;
+    while ((size_t(1) << (2 * halfBits)) < positionCount) {
+        halfBits++;
+    }
+}
+
+size_t ForestPlacement::permute(size_t position) const {
+    uint64_t mask = (uint64_t(1) << halfBits) - 1;
+    // the network permutes [0, 4^halfBits), cycle walking keeps the result below positionCount. The domain is less
+    // than four times positionCount, so that takes a few rounds at most on average
+    do {
+        uint64_t left = position >> halfBits;
+        uint64_t right = position & mask;
+        for (uint64_t round = 0; round < PLACEMENT_ROUNDS; round++) {
+            uint64_t next = left ^ (mix64(key + round * 0x9e3779b97f4a7c15ULL + right) & mask);
+            left = right;
+            right = next;
+        }
+        position = (left << halfBits) | right;
+    } while (position >= positionCount);
+    return position;
+}
+
+void ForestPlacement::locate(size_t position, size_t& treeIndex, size_t& treePosition) const {
+    if (kind == PlacementKind::RANGE || treeCount == 1) {
+        treeIndex = position / perTree;
+        treePosition = position % perTree;
+        return;
+    }
+    // dealt round robin after the permutation, so the shares differ by one position at most
+    position = permute(position);
+    treeIndex = position % treeCount;
+    treePosition = position / treeCount;
+}
+
+Forest::Forest(size_t dataSize, size_t bucketSize, size_t maxSize, const TreeConfig& config, PlacementKind placementKind) {
     size_t treeCount = 1;
     if ((dataSize + bucketSize - 1)/bucketSize > maxSize) {
         treeCount = (dataSize + maxSize - 1) / maxSize;
+    }
+    // a single tree needs no key, its random stream stays as it was
+    placement = ForestPlacement(placementKind, dataSize + 1, treeCount, treeCount > 1 ? randomU64() : 0);
+    if (treeCount > 1) {
         for (size_t i = 0; i < treeCount; ++i) {
-            trees.push_back(Tree(maxSize, bucketSize, (dataSize + treeCount - 1) / treeCount));
+            // file backed trees each get their own bucket file next to the given path
+            TreeConfig treeConfig = config;
+            if (!treeConfig.storePath.empty()) {
+                treeConfig.storePath += "." + std::to_string(i);
+            }
+            // every tree is sized for maxSize blocks and gets at most maxSize + 1 positions, so none fills up early
+            trees.push_back(Tree(maxSize, bucketSize, placement.perTree, treeConfig));
         }
     } else {
-        trees.push_back(Tree(dataSize, bucketSize));
+        trees.push_back(Tree(dataSize, bucketSize, std::nullopt, config));
+    }
+}
+
+Forest::Forest(SnapshotReader& reader) {
+    reader.expectTag("FRST");
+    size_t treeCount = reader.value<uint64_t>();
+    size_t positionCount = reader.value<uint64_t>();
+    uint64_t key = reader.value<uint64_t>();
+    uint32_t kind = reader.value<uint32_t>();
+    reader.value<uint32_t>();
+    reader.check(treeCount > 0 && treeCount <= positionCount && positionCount < (size_t(1) << 62), "tree count");
+    reader.check(kind <= static_cast<uint32_t>(PlacementKind::RANGE), "placement");
+    placement = ForestPlacement(static_cast<PlacementKind>(kind), positionCount, treeCount, key);
+    trees.reserve(treeCount);
+    for (size_t i = 0; i < treeCount; i++) {
+        trees.emplace_back(reader);
+        reader.check(treeCount == 1 || trees[i].positionMap.size() >= placement.perTree, "tree positions");
+    }
+}
+
+void Forest::save(const std::string& path) const {
+    if (!workers.empty()) {
+        throw std::logic_error("a forest cannot be saved while its workers run");
     }
+    SnapshotWriter writer(path);
+    writer.tag("FRST");
+    writer.value<uint64_t>(trees.size());
+    writer.value<uint64_t>(placement.positionCount);
+    writer.value<uint64_t>(placement.key);
+    writer.value<uint32_t>(static_cast<uint32_t>(placement.kind));
+    writer.value<uint32_t>(0);
+    for (const auto& tree : trees) {
+        tree.save(writer);
+    }
+    writer.finish();
+}
+
+Forest Forest::load(const std::string& path) {
+    SnapshotReader reader(path);
+    return Forest(reader);
+}
+
+Forest& Forest::operator=(Forest&& other) noexcept {
+    // the old trees must not be destroyed under running workers
+    stopWorkers();
+    trees = std::move(other.trees);
+    placement = other.placement;
+    workers = std::move(other.workers);
+    batchIndices = std::move(other.batchIndices);
+    batchPositions = std::move(other.batchPositions);
+    treeBatch = std::move(other.treeBatch);
+    routeStats = other.routeStats;
+    pipelineWindows = other.pipelineWindows;
+    pipelineJobs = other.pipelineJobs;
+    return *this;
+}
+
+Forest::~Forest() {
+    stopWorkers();
+}
+
+bool Forest::locate(size_t position, size_t& treeIndex, size_t& treePosition) {
+    STATS_PHASE(routeStats, PHASE_ROUTE);
+    if (position >= placement.positionCount) {
+        std::cerr << "Position out of bounds in forest placement." << std::endl;
+        std::cerr<< "max position: " << placement.positionCount - 1 << ", looking for position: " << position << std::endl;
+        return false;
+    }
+    placement.locate(position, treeIndex, treePosition);
+    return true;
 }
 
 void Forest::put(size_t position, int val, bool debugMode, std::optional<double> randomReadRatio, bool ringFlag) {
-    if (position >= positionMap.size()) {
-        std::cerr << "Position out of bounds in forest positionMap." << std::endl;
-        std::cerr<< "max position: " << positionMap.size() - 1 << ", looking for position: " << position << std::endl;
-        return;
+    size_t treeIndex;
+    size_t treePosition;
+    if (locate(position, treeIndex, treePosition)) {
+        trees[treeIndex].access(WRITE, treePosition, val, debugMode, randomReadRatio, ringFlag);
     }
-    if (positionMap[position].has_value()) {
-        size_t treeIndex = positionMap[position].value();
-        trees[treeIndex].access(WRITE, position, val, debugMode, randomReadRatio, ringFlag);
-    } else {
-        for (size_t i = 0; i < trees.size(); i ++) {
-            if (trees[i].occupied < trees[i].capacity) {
-                trees[i].access(WRITE, position - (i * trees[i].capacity), val, debugMode, randomReadRatio, ringFlag);
-                positionMap[position] = i;
-                return;
-            }
+}
+
+void Forest::bulkLoad(const StorageRecord* records, size_t count) {
+    if (!workers.empty()) {
+        throw std::logic_error("bulk load while workers are running");
+    }
+    std::vector<std::vector<size_t>> positions(trees.size());
+    std::vector<std::vector<int>> values(trees.size());
+    for (size_t i = 0; i < count; i ++) {
+        size_t treeIndex;
+        size_t treePosition;
+        if (locate(records[i].position, treeIndex, treePosition)) {
+            positions[treeIndex].push_back(treePosition);
+            values[treeIndex].push_back(records[i].value);
         }
-        std::cerr <<"all trees are full, cannot write new data." << std::endl;
+    }
+    for (size_t t = 0; t < trees.size(); t ++) {
+        trees[t].bulkLoad(positions[t].data(), values[t].data(), positions[t].size());
     }
 }
 
-std::optional<int> Forest::get(size_t position, bool debugMode, std::optional<double> randomReadRatio, bool ringFlag) {
-    if (position >= positionMap.size()) {
-        std::cerr << "Position out of bounds in forest positionMap." << std::endl;
-        return std::nullopt;
+void Forest::putPayload(size_t position, const uint8_t* payload, bool debugMode, std::optional<double> randomReadRatio, bool ringFlag) {
+    size_t treeIndex;
+    size_t treePosition;
+    if (locate(position, treeIndex, treePosition)) {
+        trees[treeIndex].accessPayload(WRITE, treePosition, payload, nullptr, debugMode, randomReadRatio, ringFlag);
     }
-    if (positionMap[position].has_value()) {
-        size_t treeIndex = positionMap[position].value();
-        return trees[treeIndex].access(READ, position - (treeIndex * trees[treeIndex].capacity), 0, debugMode, randomReadRatio, ringFlag);
+}
+
+bool Forest::getPayload(size_t position, uint8_t* payload, bool debugMode, std::optional<double> randomReadRatio, bool ringFlag) {
+    size_t treeIndex;
+    size_t treePosition;
+    if (locate(position, treeIndex, treePosition)) {
+        return trees[treeIndex].accessPayload(READ, treePosition, nullptr, payload, debugMode, randomReadRatio, ringFlag);
+    }
+    return false;
+}
+
+std::optional<int> Forest::get(size_t position, bool debugMode, std::optional<double> randomReadRatio, bool ringFlag) {
+    size_t treeIndex;
+    size_t treePosition;
+    if (locate(position, treeIndex, treePosition)) {
+        return trees[treeIndex].access(READ, treePosition, 0, debugMode, randomReadRatio, ringFlag);
     }
     return std::nullopt;
 }
 
+void Forest::accessBatch(std::vector<AccessRequest>& requests, bool debugMode, std::optional<double> randomReadRatio, bool ringFlag) {
+    batchIndices.resize(trees.size());
+    for (auto& indices : batchIndices) {
+        indices.clear();
+    }
+    batchPositions.resize(requests.size());
+    treeBatch.reserve(requests.size());
+    for (size_t i = 0; i < requests.size(); i ++) {
+        requests[i].result = std::nullopt;
+        size_t treeIndex;
+        size_t treePosition;
+        if (locate(requests[i].position, treeIndex, treePosition)) {
+            // a tree's share of a batch is at most the batch, reserving that once keeps later batches off the heap
+            batchIndices[treeIndex].reserve(requests.size());
+            batchIndices[treeIndex].push_back(i);
+            batchPositions[i] = treePosition;
+        }
+    }
+    for (size_t t = 0; t < trees.size(); t ++) {
+        if (batchIndices[t].empty()) {
+            continue;
+        }
+        treeBatch.clear();
+        for (size_t i : batchIndices[t]) {
+            treeBatch.push_back({requests[i].op, batchPositions[i], requests[i].value, std::nullopt});
+        }
+        trees[t].accessBatch(treeBatch.data(), treeBatch.size(), debugMode, randomReadRatio, ringFlag);
+        for (size_t j = 0; j < treeBatch.size(); j ++) {
+            requests[batchIndices[t][j]].result = treeBatch[j].result;
+        }
+    }
+}
+
+// answers the jobs of one window, each tree's jobs in order with one batch
+static void serveWindow(std::vector<ForestJob>& window, Tree* trees, std::vector<AccessRequest>& requests,
+                        std::vector<size_t>& members, std::vector<bool>& served) {
+    served.assign(window.size(), false);
+    for (size_t first = 0; first < window.size(); first++) {
+        if (served[first]) {
+            continue;
+        }
+        requests.clear();
+        members.clear();
+        for (size_t i = first; i < window.size(); i++) {
+            if (!served[i] && window[i].treeIndex == window[first].treeIndex) {
+                requests.push_back({window[i].op, window[i].position, window[i].value, std::nullopt});
+                members.push_back(i);
+                served[i] = true;
+            }
+        }
+        if (members.size() == 1) {
+            ForestJob& job = window[first];
+            job.result.set_value(trees[job.treeIndex].access(job.op, job.position, job.value, false, job.randomReadRatio, job.ringFlag));
+            continue;
+        }
+        trees[window[first].treeIndex].accessBatch(requests.data(), requests.size(), false, window[first].randomReadRatio, window[first].ringFlag);
+        for (size_t j = 0; j < members.size(); j++) {
+            window[members[j]].result.set_value(requests[j].result);
+        }
+    }
+}
+
+static void runWorker(ForestWorker* worker, Tree* trees, size_t workerIndex) {
+    // stream 0 belongs to the caller thread, a given seed replays every worker's random choices
+    seedThreadRandom(workerIndex + 1);
+    std::vector<ForestJob> window;
+    std::vector<AccessRequest> requests;
+    std::vector<size_t> members;
+    std::vector<bool> served;
+    ForestJob job;
+    // a job that could not join the last window because it reads with other options, it opens the next one
+    bool held = false;
+    size_t idle = 0;
+    while (true) {
+        window.clear();
+        if (held) {
+            window.push_back(std::move(job));
+            held = false;
+        }
+        while (window.size() < worker->windowSize && worker->queue.pop(job)) {
+            if (!window.empty() && (job.randomReadRatio != window[0].randomReadRatio || job.ringFlag != window[0].ringFlag)) {
+                held = true;
+                break;
+            }
+            window.push_back(std::move(job));
+        }
+        if (!window.empty()) {
+            idle = 0;
+            serveWindow(window, trees, requests, members, served);
+            worker->windows++;
+            worker->jobs += window.size();
+            continue;
+        }
+        // the producer stops pushing before it clears running, so an empty queue here is final
+        if (!worker->running.load(std::memory_order_acquire) && worker->queue.empty()) {
+            break;
+        }
+        // back off progressively so idle workers leave the cores to busy ones
+        idle++;
+        if (idle < 1024) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
+}
+
+void Forest::startWorkers(size_t threadCount, size_t queueDepth) {
+    stopWorkers();
+    threadCount = std::max<size_t>(1, std::min(threadCount, trees.size()));
+    for (size_t i = 0; i < threadCount; i ++) {
+        workers.push_back(std::make_unique<ForestWorker>());
+        // the window covers queueDepth requests for each tree the worker owns
+        size_t ownedTrees = (trees.size() - i + threadCount - 1) / threadCount;
+        workers.back()->windowSize = queueDepth > 1 ? queueDepth * ownedTrees : 1;
+        workers.back()->thread = std::thread(runWorker, workers.back().get(), trees.data(), i);
+    }
+}
+
+void Forest::stopWorkers() {
+    for (auto& worker : workers) {
+        worker->running.store(false, std::memory_order_release);
+        worker->thread.join();
+        pipelineWindows += worker->windows;
+        pipelineJobs += worker->jobs;
+    }
+    workers.clear();
+}
+
+std::future<std::optional<int>> Forest::submit(Operation op, size_t position, int val, std::optional<double> randomReadRatio, bool ringFlag) {
+    ForestJob job;
+    std::future<std::optional<int>> result = job.result.get_future();
+    if (workers.empty()) {
+        if (op == READ) {
+            job.result.set_value(get(position, false, randomReadRatio, ringFlag));
+        } else {
+            put(position, val, false, randomReadRatio, ringFlag);
+            job.result.set_value(std::nullopt);
+        }
+        return result;
+    }
+    size_t treeIndex;
+    size_t treePosition;
+    if (!locate(position, treeIndex, treePosition)) {
+        job.result.set_value(std::nullopt);
+        return result;
+    }
+    job.op = op;
+    job.treeIndex = treeIndex;
+    job.position = treePosition;
+    job.value = val;
+    job.randomReadRatio = randomReadRatio;
+    job.ringFlag = ringFlag;
+    ForestWorker& worker = *workers[treeIndex % workers.size()];
+    while (!worker.queue.push(std::move(job))) {
+        std::this_thread::yield();
+    }
+    return result;
+}
+
+std::future<std::optional<int>> Forest::asyncGet(size_t position, std::optional<double> randomReadRatio, bool ringFlag) {
+    return submit(READ, position, 0, randomReadRatio, ringFlag);
+}
+
+std::future<std::optional<int>> Forest::asyncPut(size_t position, int val, std::optional<double> randomReadRatio, bool ringFlag) {
+    return submit(WRITE, position, val, randomReadRatio, ringFlag);
+}
+
 std::string Forest::getSizes() const {
     std::string ret;
     ret = "Forest has " + std::to_string(trees.size()) + " trees.\n";
     ret += "Each tree has " + std::to_string(trees[0].capacity) + " capacity.\n";
+    ret += "Bucket store: " + trees[0].store->describe() + "\n";
+    ret += std::string("Placement: ") + (placement.kind == PlacementKind::HASH ? "hash" : "range") + ", " +
+           std::to_string(placement.perTree) + " positions per tree.\n";
     for (size_t i = 0; i < trees.size(); i ++) {
         ret += "Tree[" +std::to_string(i)+ "] have occupied: " + std::to_string(trees[i].occupied) +
-               ", capacity: " + std::to_string(trees[i].capacity) +" max stash size: " + std::to_string(trees[i].maxStashSize) + "\n";
+               ", capacity: " + std::to_string(trees[i].capacity) +" max stash size: " + std::to_string(trees[i].maxStashSize);
+        if (trees[i].config.evictionRate > 0) {
+            ret += ", scheduled evictions: " + std::to_string(trees[i].scheduledEvictions) +
+                   ", early reshuffles: " + std::to_string(trees[i].earlyReshuffles);
+        }
+        if (trees[i].stashWatermark() != SIZE_MAX) {
+            // amortized over the accesses, each one reads and writes back a whole path
+            double perAccess = trees[i].accessCount > 0 ? double(trees[i].watermarkEvictions) / trees[i].accessCount : 0.0;
+            ret += ", stash bound dummy evictions: " + std::to_string(trees[i].watermarkEvictions) + " (" + std::to_string(perAccess) + " per access)";
+        }
+        ret += "\n";
+    }
+    return ret;
+}
+
+std::string Forest::getPositionMapStats() const {
+    std::string ret;
+    size_t clientBytes = 0;
+    for (size_t i = 0; i < trees.size(); i ++) {
+        clientBytes += trees[i].positionMap.clientBytes();
+        ret += "Tree[" + std::to_string(i) + "] " + trees[i].positionMap.getStats();
     }
+    ret += "Total tree position map client bytes: " + std::to_string(clientBytes) + "\n";
     return ret;
 }
 
+CryptoStats Forest::getCryptoStats() const {
+    CryptoStats total;
+    for (const Tree& tree : trees) {
+        CryptoStats stats = tree.getCryptoStats();
+        total.sealedBuckets += stats.sealedBuckets;
+        total.openedBuckets += stats.openedBuckets;
+        total.nanoseconds += stats.nanoseconds;
+    }
+    return total;
+}
+
+BucketTransferStats Forest::getTransferStats() const {
+    BucketTransferStats total;
+    for (const Tree& tree : trees) {
+        BucketTransferStats stats = tree.getTransferStats();
+        total.accesses += stats.accesses;
+        total.storeBuckets += stats.storeBuckets;
+        total.cachedBuckets += stats.cachedBuckets;
+        total.storeSlots += stats.storeSlots;
+        total.storeBytes += stats.storeBytes;
+        total.savedBytes += stats.savedBytes;
+        total.cacheBytes += stats.cacheBytes;
+        total.roundTrips += stats.roundTrips;
+        total.wireBytes += stats.wireBytes;
+    }
+    return total;
+}
+
+AccessStats Forest::getAccessStats() const {
+    AccessStats total = routeStats;
+    for (const Tree& tree : trees) {
+        total.add(tree.getAccessStats());
+    }
+    return total;
+}
 
 std::string Forest::toString() const {
     std::string result;
@@ -67,5 +443,5 @@ std::string Forest::toString() const {
 }
 
 size_t Forest::getPosRange() const {
-    return positionMap.size();
+    return placement.positionCount;
 }
\ No newline at end of file
@@ -1,15 +1,116 @@
 #include "Tree.h"
+#include "SpscQueue.h"
+#include "StorageFile.h"
+
+#include <future>
+#include <thread>
+#include <memory>
 
 #define BUCKET_SIZE 5
 
+// how positions are spread over the trees of a forest
+enum class PlacementKind {
+    // a keyed permutation of the positions dealt round robin: neighbouring positions land on different trees
+    HASH,
+    // runs of perTree positions, the last tree gets what is left
+    RANGE
+};
+
+// maps a position to its tree and its position inside that tree, computed on the fly so the forest keeps no
+// per-position state. No tree gets more than perTree positions
+struct ForestPlacement {
+    PlacementKind kind = PlacementKind::HASH;
+    size_t positionCount = 0;
+    size_t treeCount = 1;
+    size_t perTree = 0;
+    // Feistel round key, drawn when the forest is built
+    uint64_t key = 0;
+    // a balanced Feistel network over the smallest even number of bits that covers positionCount
+    size_t halfBits = 0;
+
+    ForestPlacement() = default;
+    ForestPlacement(PlacementKind kind, size_t positionCount, size_t treeCount, uint64_t key);
+    // position must be below positionCount
+    void locate(size_t position, size_t& treeIndex, size_t& treePosition) const;
+    size_t permute(size_t position) const;
+};
+
+// one request routed to a worker, position is already relative to the tree
+struct ForestJob {
+    Operation op = READ;
+    size_t treeIndex = 0;
+    size_t position = 0;
+    int value = 0;
+    std::optional<double> randomReadRatio;
+    bool ringFlag = false;
+    std::promise<std::optional<int>> result;
+};
+
+// a worker owns every tree whose index is congruent to its id modulo the worker count,
+// so a tree's stash and buckets are only ever touched by one thread. It takes up to windowSize queued jobs at a
+// time and serves the ones of each tree as one pipelined batch
+struct ForestWorker {
+    SpscQueue<ForestJob> queue;
+    std::atomic<bool> running{true};
+    std::thread thread;
+    size_t windowSize = 1;
+    // written by the worker only, read after it joined
+    uint64_t windows = 0;
+    uint64_t jobs = 0;
+};
+
 class Forest {
 public:
     std::vector<Tree> trees;
-    std::vector<std::optional<size_t>> positionMap;
-    Forest(size_t dataSize, size_t bucketSize = BUCKET_SIZE, size_t maxSize = MAX_TREE_SIZE);
+    ForestPlacement placement;
+    std::vector<std::unique_ptr<ForestWorker>> workers;
+    // accessBatch scratch
+    std::vector<std::vector<size_t>> batchIndices;
+    std::vector<size_t> batchPositions;
+    std::vector<AccessRequest> treeBatch;
+    AccessStats routeStats;
+    // windows served by workers that have stopped, and the jobs in them
+    uint64_t pipelineWindows = 0;
+    uint64_t pipelineJobs = 0;
+    Forest(size_t dataSize, size_t bucketSize = BUCKET_SIZE, size_t maxSize = MAX_TREE_SIZE, const TreeConfig& config = TreeConfig(),
+           PlacementKind placementKind = PlacementKind::HASH);
+    Forest(Forest&& other) noexcept = default;
+    Forest& operator=(Forest&& other) noexcept;
+    ~Forest();
     void put(size_t position, int val, bool debugMode = false, std::optional<double> randomReadRatio = std::nullopt, bool ringFlag = false);
+    // initial load of a new forest, entries are routed like put and each tree is filled by Tree::bulkLoad
+    void bulkLoad(const StorageRecord* records, size_t count);
+    // payload bytes of a position, TreeConfig::payloadSize of them. getPayload returns false when nothing is stored
+    void putPayload(size_t position, const uint8_t* payload, bool debugMode = false, std::optional<double> randomReadRatio = std::nullopt, bool ringFlag = false);
+    bool getPayload(size_t position, uint8_t* payload, bool debugMode = false, std::optional<double> randomReadRatio = std::nullopt, bool ringFlag = false);
     std::optional<int> get(size_t position, bool debugMode = false, std::optional<double> randomReadRatio = std::nullopt, bool ringFlag = false);
+    // groups the requests by tree and serves each group with one Tree::accessBatch, results land in requests
+    void accessBatch(std::vector<AccessRequest>& requests, bool debugMode = false, std::optional<double> randomReadRatio = std::nullopt, bool ringFlag = false);
+    // concurrent mode: while workers run, requests must go through asyncGet/asyncPut from a single caller thread.
+    // A worker serves about queueDepth waiting requests per tree together: every path is fetched before any of them
+    // is written back, and the requests are answered in submission order from the stash, so a read sees every
+    // earlier write to its position
+    void startWorkers(size_t threadCount, size_t queueDepth = 1);
+    void stopWorkers();
+    // served by the workers when they run, otherwise right away with a ready future
+    std::future<std::optional<int>> asyncGet(size_t position, std::optional<double> randomReadRatio = std::nullopt, bool ringFlag = false);
+    std::future<std::optional<int>> asyncPut(size_t position, int val, std::optional<double> randomReadRatio = std::nullopt, bool ringFlag = false);
     std::string toString() const;
     std::string getSizes() const;
+    std::string getPositionMapStats() const;
+    CryptoStats getCryptoStats() const;
+    BucketTransferStats getTransferStats() const;
+    // data trees plus the routing time spent here, zero unless built with ORAM_STATS
+    AccessStats getAccessStats() const;
     size_t getPosRange() const;
-};
\ No newline at end of file
+    // writes the whole client and server state to one snapshot file, workers must be stopped. Throws on failure
+    void save(const std::string& path) const;
+    // a forest as it was saved: buckets are used in place from a copy-on-write mapping of the file, so nothing is
+    // replayed and later accesses never change the snapshot. Throws when the file is missing or damaged
+    static Forest load(const std::string& path);
+private:
+    explicit Forest(SnapshotReader& reader);
+    // false for a position out of range
+    bool locate(size_t position, size_t& treeIndex, size_t& treePosition);
+    std::future<std::optional<int>> submit(Operation op, size_t position, int val, std::optional<double> randomReadRatio, bool ringFlag);
+};
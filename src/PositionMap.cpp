@@ -0,0 +1,288 @@
+#include "PositionMap.h"
+#include "Tree.h"
+
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+// payload bytes of a map tree block, its packed labels travel there
+#define MAP_BLOCK_BYTES 64
+
+// the narrowest of 1, 2, 4 or 8 bytes that holds every value up to largest
+static size_t fieldWidth(size_t largest) {
+    size_t width = 1;
+    while (width < sizeof(uint64_t) && (largest >> (8 * width)) != 0) {
+        width *= 2;
+    }
+    return width;
+}
+
+// a field is copied through a value of its width, so the layout follows the host byte order like the snapshot
+static size_t readField(const uint8_t* field, size_t width) {
+    switch (width) {
+    case 1:
+        return *field;
+    case 2: {
+        uint16_t value;
+        std::memcpy(&value, field, sizeof(value));
+        return value;
+    }
+    case 4: {
+        uint32_t value;
+        std::memcpy(&value, field, sizeof(value));
+        return value;
+    }
+    default: {
+        uint64_t value;
+        std::memcpy(&value, field, sizeof(value));
+        return static_cast<size_t>(value);
+    }
+    }
+}
+
+static void writeField(uint8_t* field, size_t width, size_t value) {
+    switch (width) {
+    case 1:
+        *field = static_cast<uint8_t>(value);
+        break;
+    case 2: {
+        uint16_t narrow = static_cast<uint16_t>(value);
+        std::memcpy(field, &narrow, sizeof(narrow));
+        break;
+    }
+    case 4: {
+        uint32_t narrow = static_cast<uint32_t>(value);
+        std::memcpy(field, &narrow, sizeof(narrow));
+        break;
+    }
+    default: {
+        uint64_t wide = value;
+        std::memcpy(field, &wide, sizeof(wide));
+        break;
+    }
+    }
+}
+
+static size_t presenceWords(size_t entryCount) {
+    return (entryCount + 63) / 64;
+}
+
+PositionMap::PositionMap(size_t entryCount, size_t leafCount, size_t bucketSize, const TreeConfig& config)
+    : labelWidth(fieldWidth(leafCount - 1)), entryCount(entryCount), leafCount(leafCount), packedWidth(fieldWidth(leafCount)),
+      labelsPerBlock(0), accesses(0), nanoseconds(0) {
+    // packed labels are stored as label + 1 so that an all-zero field marks a position that was never written
+    labelsPerBlock = MAP_BLOCK_BYTES / packedWidth;
+
+    size_t flatBytes = entryCount * labelWidth + presenceWords(entryCount) * sizeof(uint64_t);
+    if (config.posMapBudget.has_value() && flatBytes > config.posMapBudget.value()) {
+        size_t blockCount = (entryCount + labelsPerBlock - 1) / labelsPerBlock;
+        if (blockCount + 1 < entryCount) {
+            // the map tree's own position map has blockCount + 1 entries, so the recursion always shrinks
+            TreeConfig mapConfig = config;
+            // map blocks only carry their packed labels, whatever payload the data blocks have
+            mapConfig.payloadSize = MAP_BLOCK_BYTES;
+            if (!mapConfig.storePath.empty()) {
+                mapConfig.storePath += ".map";
+            }
+            tree = std::make_unique<Tree>(blockCount, bucketSize, std::nullopt, mapConfig);
+            return;
+        }
+    }
+    flatLabels.assign(entryCount * labelWidth, 0);
+    present.assign(presenceWords(entryCount), 0);
+}
+
+PositionMap::PositionMap(SnapshotReader& reader, size_t leafCount) : labelWidth(1), leafCount(leafCount), accesses(0), nanoseconds(0) {
+    reader.expectTag("PMAP");
+    entryCount = reader.value<uint64_t>();
+    packedWidth = reader.value<uint64_t>();
+    labelsPerBlock = reader.value<uint64_t>();
+    bool recursive = reader.value<uint64_t>() != 0;
+    reader.check(packedWidth == fieldWidth(leafCount) && labelsPerBlock == MAP_BLOCK_BYTES / packedWidth, "label width");
+    if (recursive) {
+        tree = std::make_unique<Tree>(reader);
+        return;
+    }
+    labelWidth = reader.value<uint64_t>();
+    reader.check(labelWidth == fieldWidth(leafCount - 1), "flat label width");
+    reader.check(entryCount <= SIZE_MAX / sizeof(uint64_t), "entry count");
+    const uint8_t* words = reader.bytes(presenceWords(entryCount) * sizeof(uint64_t));
+    present.resize(presenceWords(entryCount));
+    std::memcpy(present.data(), words, present.size() * sizeof(uint64_t));
+    const uint8_t* labels = reader.bytes(entryCount * labelWidth);
+    flatLabels.assign(labels, labels + entryCount * labelWidth);
+    // the labels pick the paths a tree reads, one past its leaves would reach outside the store
+    reader.check(entryCount % 64 == 0 || (present.back() >> (entryCount % 64)) == 0, "presence bitmap");
+    for (size_t position = 0; position < entryCount; position++) {
+        reader.check(!hasFlatLabel(position) || flatLabel(position) < leafCount, "flat label");
+    }
+}
+
+void PositionMap::save(SnapshotWriter& writer) const {
+    writer.tag("PMAP");
+    writer.value<uint64_t>(entryCount);
+    writer.value<uint64_t>(packedWidth);
+    writer.value<uint64_t>(labelsPerBlock);
+    writer.value<uint64_t>(tree ? 1 : 0);
+    if (tree) {
+        tree->save(writer);
+        return;
+    }
+    writer.value<uint64_t>(labelWidth);
+    writer.bytes(present.data(), present.size() * sizeof(uint64_t));
+    writer.bytes(flatLabels.data(), flatLabels.size());
+}
+
+PositionMap::PositionMap(PositionMap&& other) noexcept = default;
+PositionMap& PositionMap::operator=(PositionMap&& other) noexcept = default;
+PositionMap::~PositionMap() = default;
+
+size_t PositionMap::size() const {
+    return entryCount;
+}
+
+bool PositionMap::isRecursive() const {
+    return tree != nullptr;
+}
+
+bool PositionMap::hasFlatLabel(size_t position) const {
+    return ((present[position / 64] >> (position % 64)) & 1) != 0;
+}
+
+size_t PositionMap::flatLabel(size_t position) const {
+    return readField(flatLabels.data() + position * labelWidth, labelWidth);
+}
+
+void PositionMap::setFlatLabel(size_t position, size_t label) {
+    writeField(flatLabels.data() + position * labelWidth, labelWidth, label);
+    present[position / 64] |= uint64_t(1) << (position % 64);
+}
+
+std::optional<size_t> PositionMap::peek(size_t position) const {
+    if (tree) {
+        return std::nullopt;
+    }
+    if (!hasFlatLabel(position)) {
+        return std::nullopt;
+    }
+    return flatLabel(position);
+}
+
+std::optional<size_t> PositionMap::exchange(size_t position, size_t newLabel, bool assignIfMissing) {
+    if (!tree) {
+        std::optional<size_t> oldLabel = peek(position);
+        if (oldLabel.has_value() || assignIfMissing) {
+            setFlatLabel(position, newLabel);
+        }
+        return oldLabel;
+    }
+
+    auto startTime = std::chrono::steady_clock::now();
+    size_t evictPath;
+    // a missing map block is created holding only empty fields
+    Block* block = tree->fetch(WRITE, position / labelsPerBlock, 0, evictPath);
+    if (block == nullptr) {
+        return std::nullopt;
+    }
+    uint8_t* field = tree->payloadOf(block) + (position % labelsPerBlock) * packedWidth;
+    size_t stored = readField(field, packedWidth);
+    std::optional<size_t> oldLabel = std::nullopt;
+    if (stored != 0) {
+        oldLabel = stored - 1;
+    }
+    // a plaintext map tree loaded from a snapshot is only checked here, when one of its labels is used
+    if (oldLabel.has_value() && oldLabel.value() >= leafCount) {
+        throw std::runtime_error("position map label " + std::to_string(oldLabel.value()) + " is outside the tree");
+    }
+    if (oldLabel.has_value() || assignIfMissing) {
+        writeField(field, packedWidth, newLabel + 1);
+    }
+    tree->finishAccess(evictPath);
+    accesses++;
+    nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+    return oldLabel;
+}
+
+void PositionMap::load(const size_t* positions, const size_t* labels, size_t count) {
+    if (!tree) {
+        for (size_t i = 0; i < count; i++) {
+            setFlatLabel(positions[i], labels[i]);
+        }
+        return;
+    }
+    size_t blockCount = (entryCount + labelsPerBlock - 1) / labelsPerBlock;
+    std::vector<uint8_t> packed(blockCount * MAP_BLOCK_BYTES, 0);
+    std::vector<bool> used(blockCount, false);
+    for (size_t i = 0; i < count; i++) {
+        size_t blockPosition = positions[i] / labelsPerBlock;
+        writeField(&packed[blockPosition * MAP_BLOCK_BYTES + (positions[i] % labelsPerBlock) * packedWidth], packedWidth, labels[i] + 1);
+        used[blockPosition] = true;
+    }
+    // only the map blocks holding a label exist, as if they had been created by exchange
+    std::vector<size_t> blockPositions;
+    std::vector<uint8_t> blockPayloads;
+    for (size_t i = 0; i < blockCount; i++) {
+        if (used[i]) {
+            blockPositions.push_back(i);
+            blockPayloads.insert(blockPayloads.end(), packed.begin() + i * MAP_BLOCK_BYTES, packed.begin() + (i + 1) * MAP_BLOCK_BYTES);
+        }
+    }
+    std::vector<int> blockValues(blockPositions.size(), 0);
+    tree->bulkLoad(blockPositions.data(), blockValues.data(), blockPositions.size(), blockPayloads.data());
+}
+
+size_t PositionMap::clientBytes() const {
+    if (!tree) {
+        return flatLabels.size() + present.size() * sizeof(uint64_t);
+    }
+    // the map trees live on the server, only their stashes and the top level map stay with the client
+    return tree->stash.size() * sizeof(Block) + tree->positionMap.clientBytes();
+}
+
+CryptoStats PositionMap::getCryptoStats() const {
+    if (!tree) {
+        return CryptoStats();
+    }
+    return tree->getCryptoStats();
+}
+
+BucketTransferStats PositionMap::getTransferStats() const {
+    if (!tree) {
+        return BucketTransferStats();
+    }
+    BucketTransferStats stats = tree->getTransferStats();
+    // map tree accesses are part of the data tree's accesses
+    stats.accesses = 0;
+    return stats;
+}
+
+std::vector<PositionMapLevelStats> PositionMap::getLevelStats() const {
+    std::vector<PositionMapLevelStats> levels;
+    levels.push_back({entryCount, tree ? labelsPerBlock : 1, tree ? tree->nodeCount : 0, accesses, nanoseconds});
+    if (tree) {
+        std::vector<PositionMapLevelStats> deeper = tree->positionMap.getLevelStats();
+        levels.insert(levels.end(), deeper.begin(), deeper.end());
+    }
+    return levels;
+}
+
+std::string PositionMap::getStats() const {
+    std::vector<PositionMapLevelStats> levels = getLevelStats();
+    std::string ret = "Position map: " + std::string(tree ? "recursive" : "flat") + ", " + std::to_string(levels.size()) +
+                      " level(s), client bytes: " + std::to_string(clientBytes()) + "\n";
+    for (size_t i = 0; i < levels.size(); i++) {
+        const PositionMapLevelStats& level = levels[i];
+        ret += "  Level[" + std::to_string(i) + "] entries: " + std::to_string(level.entries);
+        if (level.treeNodes == 0) {
+            ret += ", flat\n";
+            continue;
+        }
+        // time is inclusive of the deeper levels this access recursed into
+        uint64_t average = level.accesses > 0 ? level.nanoseconds / level.accesses : 0;
+        ret += ", labels per block: " + std::to_string(level.labelsPerBlock) +
+               ", map tree nodes: " + std::to_string(level.treeNodes) +
+               ", accesses: " + std::to_string(level.accesses) +
+               ", avg access: " + std::to_string(average) + " ns\n";
+    }
+    return ret;
+}
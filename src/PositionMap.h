@@ -0,0 +1,77 @@
+#ifndef POSITION_MAP_H
+#define POSITION_MAP_H
+
+#include <vector>
+#include <string>
+#include <optional>
+#include <memory>
+#include <cstdint>
+
+#include "BucketStore.h"
+#include "TreeConfig.h"
+
+class Tree;
+class SnapshotReader;
+class SnapshotWriter;
+
+// per level access counters of a recursive position map, level 0 is the map of the data tree
+struct PositionMapLevelStats {
+    size_t entries;
+    size_t labelsPerBlock;
+    size_t treeNodes;
+    size_t accesses;
+    uint64_t nanoseconds;
+};
+
+// maps a tree position to its leaf label (0 .. leafCount - 1).
+// flat mode keeps every label in client memory, packed to the narrowest of 1, 2, 4 or 8 bytes that holds
+// leafCount - 1 with a presence bit per position, recursive mode packs labels into the 64 byte payloads of the blocks
+// of a smaller ORAM tree whose own map recurses until it fits under the byte budget.
+class PositionMap {
+public:
+    PositionMap(size_t entryCount = 0, size_t leafCount = 1, size_t bucketSize = 4, const TreeConfig& config = TreeConfig());
+    // throws runtime_error when the saved map does not fit a tree of leafCount leaves
+    PositionMap(SnapshotReader& reader, size_t leafCount);
+    PositionMap(PositionMap&& other) noexcept;
+    PositionMap& operator=(PositionMap&& other) noexcept;
+    ~PositionMap();
+
+    size_t size() const;
+    bool isRecursive() const;
+    // flat mode only, recursive lookups must go through exchange
+    std::optional<size_t> peek(size_t position) const;
+    // returns the current label of position and replaces it with newLabel,
+    // a missing position is only assigned when assignIfMissing is set
+    std::optional<size_t> exchange(size_t position, size_t newLabel, bool assignIfMissing);
+    // assigns labels to distinct, never written positions in one go, a recursive map bulk loads its tree
+    void load(const size_t* positions, const size_t* labels, size_t count);
+    // the flat labels, or the map tree recursively
+    void save(SnapshotWriter& writer) const;
+    size_t clientBytes() const;
+    // cipher work done by the map trees, zero in flat mode
+    CryptoStats getCryptoStats() const;
+    BucketTransferStats getTransferStats() const;
+    std::vector<PositionMapLevelStats> getLevelStats() const;
+    std::string getStats() const;
+
+private:
+    // flat mode only, position must be present for flatLabel
+    bool hasFlatLabel(size_t position) const;
+    size_t flatLabel(size_t position) const;
+    void setFlatLabel(size_t position, size_t label);
+
+    // labelWidth bytes per position, and one bit per position telling whether it was ever written
+    std::vector<uint8_t> flatLabels;
+    std::vector<uint64_t> present;
+    size_t labelWidth;
+    std::unique_ptr<Tree> tree;
+    size_t entryCount;
+    size_t leafCount;
+    // bytes of a packed label in a map block, wide enough for leafCount since labels are stored plus one
+    size_t packedWidth;
+    size_t labelsPerBlock;
+    size_t accesses;
+    uint64_t nanoseconds;
+};
+
+#endif // POSITION_MAP_H
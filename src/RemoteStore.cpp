@@ -0,0 +1,370 @@
+#include "RemoteStore.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <climits>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// write-backs in flight before the client stops to collect their acknowledgements, far below what the socket
+// buffers hold so neither side ever blocks on the other
+#define MAX_PENDING_WRITES 64
+
+static_assert(sizeof(size_t) == sizeof(uint64_t), "node ids go on the wire as they are");
+
+#ifndef _WIN32
+
+// moves every byte the vectors describe, false once the peer is gone. A partial transfer resumes mid vector
+static bool transferAll(int fd, iovec* parts, size_t partCount, bool sending) {
+    while (true) {
+        while (partCount > 0 && parts->iov_len == 0) {
+            parts++;
+            partCount--;
+        }
+        if (partCount == 0) {
+            return true;
+        }
+        msghdr message = {};
+        message.msg_iov = parts;
+        message.msg_iovlen = std::min<size_t>(partCount, IOV_MAX);
+        ssize_t moved = sending ? ::sendmsg(fd, &message, MSG_NOSIGNAL) : ::recvmsg(fd, &message, MSG_WAITALL);
+        if (moved < 0 && errno == EINTR) {
+            continue;
+        }
+        if (moved <= 0) {
+            return false;
+        }
+        size_t left = static_cast<size_t>(moved);
+        while (partCount > 0 && left >= parts->iov_len) {
+            left -= parts->iov_len;
+            parts++;
+            partCount--;
+        }
+        if (left > 0) {
+            parts->iov_base = static_cast<uint8_t*>(parts->iov_base) + left;
+            parts->iov_len -= left;
+        }
+    }
+}
+
+static sockaddr_un socketAddress(const std::string& socketPath) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("socket path " + socketPath + " is too long");
+    }
+    std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+    return address;
+}
+
+RemoteBucketStore::RemoteBucketStore(const std::string& socketPath, size_t firstRecord, size_t recordCount, size_t recordSize)
+    : socketPath(socketPath) {
+    first = firstRecord;
+    size = recordSize;
+    count = recordCount;
+    stride = recordSize;
+    sockaddr_un address = socketAddress(socketPath);
+    fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        throw std::runtime_error("cannot connect to the bucket server at " + socketPath);
+    }
+    uint64_t geometry[2] = {firstRecord, recordSize};
+    WireHeader header = {WIRE_OPEN, 0, nextRequest++, recordCount, sizeof(geometry)};
+    iovec parts[2] = {{&header, sizeof(header)}, {geometry, sizeof(geometry)}};
+    if (!transferAll(fd, parts, 2, true)) {
+        ::close(fd);
+        throw std::runtime_error("lost the bucket server at " + socketPath);
+    }
+    bytesSent += sizeof(header) + sizeof(geometry);
+    try {
+        response();
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+    trips++;
+}
+
+RemoteBucketStore::~RemoteBucketStore() {
+    try {
+        collectAcks();
+    } catch (const std::exception&) {
+        // the server is gone, there is nobody left to tell
+    }
+    ::close(fd);
+}
+
+void RemoteBucketStore::request(WireOp op, const size_t* nodeIDs, size_t nodeCount, const uint8_t* in) {
+    size_t recordBytes = in ? nodeCount * size : 0;
+    WireHeader header = {op, 0, nextRequest++, nodeCount, nodeCount * sizeof(uint64_t) + recordBytes};
+    iovec parts[3] = {{&header, sizeof(header)},
+                      {const_cast<size_t*>(nodeIDs), nodeCount * sizeof(uint64_t)},
+                      {const_cast<uint8_t*>(in), recordBytes}};
+    if (!transferAll(fd, parts, 3, true)) {
+        throw std::runtime_error("lost the bucket server at " + socketPath);
+    }
+    bytesSent += sizeof(header) + header.length;
+}
+
+WireHeader RemoteBucketStore::response() {
+    WireHeader header;
+    iovec part = {&header, sizeof(header)};
+    if (!transferAll(fd, &part, 1, false)) {
+        throw std::runtime_error("lost the bucket server at " + socketPath);
+    }
+    bytesReceived += sizeof(header);
+    if (header.status != 0) {
+        std::string message(std::min<uint64_t>(header.length, 4096), '\0');
+        iovec text = {&message[0], message.size()};
+        transferAll(fd, &text, 1, false);
+        throw std::runtime_error("bucket server: " + message);
+    }
+    if (header.request != nextResponse++) {
+        throw std::runtime_error("the bucket server answered out of order");
+    }
+    return header;
+}
+
+void RemoteBucketStore::collectAcks() {
+    while (pendingAcks > 0) {
+        response();
+        pendingAcks--;
+    }
+}
+
+void RemoteBucketStore::readRecords(const size_t* nodeIDs, size_t nodeCount, uint8_t* out) {
+    if (nodeCount == 0) {
+        return;
+    }
+    // the request goes out first, the server works on it while the earlier acknowledgements are read
+    request(WIRE_READ, nodeIDs, nodeCount, nullptr);
+    collectAcks();
+    WireHeader header = response();
+    if (header.length != nodeCount * size) {
+        throw std::runtime_error("the bucket server sent " + std::to_string(header.length) + " record bytes, expected " +
+                                 std::to_string(nodeCount * size));
+    }
+    iovec part = {out, nodeCount * size};
+    if (!transferAll(fd, &part, 1, false)) {
+        throw std::runtime_error("lost the bucket server at " + socketPath);
+    }
+    bytesReceived += header.length;
+    trips++;
+}
+
+void RemoteBucketStore::writeRecords(const size_t* nodeIDs, size_t nodeCount, const uint8_t* in) {
+    if (nodeCount == 0) {
+        return;
+    }
+    if (pendingAcks >= MAX_PENDING_WRITES) {
+        collectAcks();
+    }
+    request(WIRE_WRITE, nodeIDs, nodeCount, in);
+    pendingAcks++;
+}
+
+void RemoteBucketStore::sync() {
+    collectAcks();
+}
+
+struct BucketServer::Connection {
+    int fd;
+    std::unique_ptr<BucketStore> store;
+    std::vector<uint64_t> nodeIDs;
+    // one vector per record, so records go straight between the socket and the store
+    std::vector<iovec> parts;
+};
+
+BucketServer::BucketServer(const std::string& socketPath, const std::string& storePrefix)
+    : socketPath(socketPath), storePrefix(storePrefix) {
+    sockaddr_un address = socketAddress(socketPath);
+    listenFD = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFD < 0) {
+        throw std::runtime_error("cannot create a socket");
+    }
+    // a socket file left by a server that did not shut down cleanly would make bind fail
+    ::unlink(socketPath.c_str());
+    if (::bind(listenFD, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(listenFD, SOMAXCONN) != 0) {
+        ::close(listenFD);
+        throw std::runtime_error("cannot listen on " + socketPath);
+    }
+    if (::pipe(wakeFDs) != 0) {
+        ::close(listenFD);
+        ::unlink(socketPath.c_str());
+        throw std::runtime_error("cannot create the wake-up pipe");
+    }
+}
+
+BucketServer::~BucketServer() {
+    ::close(listenFD);
+    ::unlink(socketPath.c_str());
+    ::close(wakeFDs[0]);
+    ::close(wakeFDs[1]);
+}
+
+void BucketServer::stop() {
+    stopping = true;
+    char wake = 1;
+    while (::write(wakeFDs[1], &wake, 1) < 0 && errno == EINTR) {
+    }
+}
+
+void BucketServer::run() {
+    std::vector<Connection> connections;
+    std::vector<pollfd> polled;
+    while (!stopping) {
+        polled.clear();
+        polled.push_back({listenFD, POLLIN, 0});
+        polled.push_back({wakeFDs[0], POLLIN, 0});
+        for (const Connection& connection : connections) {
+            polled.push_back({connection.fd, POLLIN, 0});
+        }
+        if (::poll(polled.data(), polled.size(), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("poll failed on " + socketPath);
+        }
+        if (polled[1].revents != 0) {
+            break;
+        }
+        // backwards, so dropping a connection leaves the indices still to visit in place
+        for (size_t i = connections.size(); i-- > 0;) {
+            if (polled[2 + i].revents != 0 && !serve(connections[i])) {
+                ::close(connections[i].fd);
+                connections.erase(connections.begin() + i);
+            }
+        }
+        if (polled[0].revents & POLLIN) {
+            int client = ::accept(listenFD, nullptr, nullptr);
+            if (client >= 0) {
+                connections.push_back(Connection{client, nullptr, {}, {}});
+            }
+        }
+    }
+    for (const Connection& connection : connections) {
+        ::close(connection.fd);
+    }
+}
+
+// sends an error answer, the connection is dropped after it
+static bool refuse(int fd, const WireHeader& request, const std::string& message) {
+    WireHeader header = {request.op, 1, request.request, 0, message.size()};
+    iovec parts[2] = {{&header, sizeof(header)}, {const_cast<char*>(message.data()), message.size()}};
+    transferAll(fd, parts, 2, true);
+    return false;
+}
+
+bool BucketServer::serve(Connection& connection) {
+    WireHeader header;
+    iovec part = {&header, sizeof(header)};
+    if (!transferAll(connection.fd, &part, 1, false)) {
+        return false;
+    }
+    requests++;
+    WireHeader answer = {header.op, 0, header.request, 0, 0};
+    if (header.op == WIRE_OPEN) {
+        uint64_t geometry[2];
+        iovec body = {geometry, sizeof(geometry)};
+        if (header.length != sizeof(geometry) || !transferAll(connection.fd, &body, 1, false)) {
+            return refuse(connection.fd, header, "malformed open request");
+        }
+        if (connection.store) {
+            return refuse(connection.fd, header, "the connection already has a store");
+        }
+        if (geometry[1] == 0 || (header.count > 0 && geometry[1] > SIZE_MAX / header.count)) {
+            return refuse(connection.fd, header, "bad store geometry");
+        }
+        try {
+            std::string path = storePrefix.empty() ? "" : storePrefix + "." + std::to_string(opened);
+            connection.store = makeBucketStore(path, geometry[0], header.count, geometry[1]);
+        } catch (const std::exception& error) {
+            return refuse(connection.fd, header, error.what());
+        }
+        opened++;
+        iovec reply = {&answer, sizeof(answer)};
+        return transferAll(connection.fd, &reply, 1, true);
+    }
+    if (header.op != WIRE_READ && header.op != WIRE_WRITE) {
+        return refuse(connection.fd, header, "unknown request " + std::to_string(header.op));
+    }
+    BucketStore* store = connection.store.get();
+    if (!store) {
+        return refuse(connection.fd, header, "no store opened");
+    }
+    size_t recordBytes = header.op == WIRE_WRITE ? store->recordSize() : 0;
+    if (header.count > store->recordCount() || header.length != header.count * (sizeof(uint64_t) + recordBytes)) {
+        return refuse(connection.fd, header, "malformed request");
+    }
+    connection.nodeIDs.resize(header.count);
+    iovec ids = {connection.nodeIDs.data(), header.count * sizeof(uint64_t)};
+    if (!transferAll(connection.fd, &ids, 1, false)) {
+        return false;
+    }
+    for (uint64_t nodeID : connection.nodeIDs) {
+        if (!store->holds(nodeID) || nodeID - store->firstRecord() >= store->recordCount()) {
+            return refuse(connection.fd, header, "node " + std::to_string(nodeID) + " is not in the store");
+        }
+    }
+    connection.parts.clear();
+    if (header.op == WIRE_READ) {
+        answer.count = header.count;
+        answer.length = header.count * store->recordSize();
+        connection.parts.push_back({&answer, sizeof(answer)});
+    }
+    for (uint64_t nodeID : connection.nodeIDs) {
+        connection.parts.push_back({store->record(nodeID), store->recordSize()});
+    }
+    if (header.op == WIRE_WRITE) {
+        if (!transferAll(connection.fd, connection.parts.data(), connection.parts.size(), false)) {
+            return false;
+        }
+        connection.parts.clear();
+        connection.parts.push_back({&answer, sizeof(answer)});
+    }
+    return transferAll(connection.fd, connection.parts.data(), connection.parts.size(), true);
+}
+
+#else
+
+RemoteBucketStore::RemoteBucketStore(const std::string& socketPath, size_t, size_t, size_t) : socketPath(socketPath) {
+    throw std::runtime_error("remote bucket stores need UNIX sockets");
+}
+
+RemoteBucketStore::~RemoteBucketStore() {}
+
+void RemoteBucketStore::readRecords(const size_t*, size_t, uint8_t*) {}
+
+void RemoteBucketStore::writeRecords(const size_t*, size_t, const uint8_t*) {}
+
+void RemoteBucketStore::sync() {}
+
+struct BucketServer::Connection {};
+
+BucketServer::BucketServer(const std::string& socketPath, const std::string& storePrefix)
+    : socketPath(socketPath), storePrefix(storePrefix) {
+    throw std::runtime_error("the bucket server needs UNIX sockets");
+}
+
+BucketServer::~BucketServer() {}
+
+void BucketServer::run() {}
+
+void BucketServer::stop() {}
+
+#endif
+
+std::string RemoteBucketStore::describe() const {
+    return "remote " + socketPath + ", " + std::to_string(count) + " records of " + std::to_string(size) + " bytes";
+}
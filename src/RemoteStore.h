@@ -0,0 +1,104 @@
+#ifndef REMOTE_STORE_H
+#define REMOTE_STORE_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "BucketStore.h"
+
+// bucket records served over a UNIX socket. Every message is a 32 byte frame header in host byte order (the server
+// is always local) followed by length body bytes. A connection carries one store: OPEN sends its geometry, READ sends
+// count node ids and gets count records back, WRITE sends count node ids and then the records. The server answers
+// every request in order, echoing its request number, and records travel straight between the socket and the
+// caller's buffers or the server's store
+enum WireOp : uint32_t {
+    WIRE_OPEN = 1,
+    WIRE_READ = 2,
+    WIRE_WRITE = 3,
+};
+
+struct WireHeader {
+    uint32_t op;
+    // 0 on success, otherwise the body is an error message
+    uint32_t status;
+    uint64_t request;
+    uint64_t count;
+    uint64_t length;
+};
+
+// the records of one tree on an oram_server. Paths are read with one request each, write-backs are pipelined:
+// their acknowledgements are only collected before the next read, or once too many are in flight
+class RemoteBucketStore : public BucketStore {
+public:
+    // connects and has the server create zeroed records, throws runtime_error when the server is unreachable
+    RemoteBucketStore(const std::string& socketPath, size_t firstRecord, size_t recordCount, size_t recordSize);
+    ~RemoteBucketStore() override;
+    bool inPlace() const override {
+        return false;
+    }
+    void readRecords(const size_t* nodeIDs, size_t nodeCount, uint8_t* out) override;
+    void writeRecords(const size_t* nodeIDs, size_t nodeCount, const uint8_t* in) override;
+    // waits until the server has applied every write
+    void sync() override;
+    uint64_t roundTrips() const override {
+        return trips;
+    }
+    uint64_t wireBytes() const override {
+        return bytesSent + bytesReceived;
+    }
+    std::string describe() const override;
+
+private:
+    // sends a header, the node ids and optionally count records from in
+    void request(WireOp op, const size_t* nodeIDs, size_t nodeCount, const uint8_t* in);
+    // reads the next response header, throws on an error answer
+    WireHeader response();
+    void collectAcks();
+
+    std::string socketPath;
+    int fd = -1;
+    uint64_t nextRequest = 0;
+    // answers come in request order
+    uint64_t nextResponse = 0;
+    // write requests sent whose acknowledgement is still on the wire
+    uint64_t pendingAcks = 0;
+    uint64_t trips = 0;
+    uint64_t bytesSent = 0;
+    uint64_t bytesReceived = 0;
+};
+
+// serves RemoteBucketStore connections from one thread, any number of them multiplexed with poll. Each connection
+// owns its own records until it closes
+class BucketServer {
+public:
+    // listens on socketPath, replacing a stale socket file. An empty storePrefix keeps every store in memory,
+    // otherwise connection n gets the bucket file storePrefix.n
+    explicit BucketServer(const std::string& socketPath, const std::string& storePrefix = "");
+    ~BucketServer();
+    // returns once stop is called, from any thread
+    void run();
+    void stop();
+    uint64_t servedRequests() const {
+        return requests;
+    }
+
+private:
+    struct Connection;
+    // answers one request of connection, false once the connection is closed or broken
+    bool serve(Connection& connection);
+
+    std::string socketPath;
+    std::string storePrefix;
+    int listenFD = -1;
+    // written by stop to wake poll
+    int wakeFDs[2] = {-1, -1};
+    std::atomic<bool> stopping{false};
+    uint64_t opened = 0;
+    uint64_t requests = 0;
+};
+
+#endif // REMOTE_STORE_H
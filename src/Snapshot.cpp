@@ -0,0 +1,158 @@
+#include "Snapshot.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t length;
+    uint64_t padding;
+};
+
+SnapshotWriter::SnapshotWriter(const std::string& path) : path(path), output(path, std::ios::binary | std::ios::trunc) {
+    if (!output) {
+        throw std::runtime_error("cannot create " + path);
+    }
+    // the header is written again by finish, a snapshot cut short keeps a zero length and is rejected
+    SnapshotHeader header = {};
+    value(header);
+}
+
+void SnapshotWriter::bytes(const void* data, size_t length) {
+    output.write(static_cast<const char*>(data), static_cast<std::streamsize>(length));
+    if (!output) {
+        throw std::runtime_error("cannot write " + path);
+    }
+    offset += length;
+}
+
+void SnapshotWriter::tag(const char* name) {
+    bytes(name, 4);
+}
+
+void SnapshotWriter::alignPage() {
+    static const char zeros[STORE_PAGE_SIZE] = {};
+    size_t padding = (STORE_PAGE_SIZE - offset % STORE_PAGE_SIZE) % STORE_PAGE_SIZE;
+    bytes(zeros, padding);
+}
+
+void SnapshotWriter::finish() {
+    SnapshotHeader header = {};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.length = offset;
+    output.seekp(0);
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    output.close();
+    if (!output) {
+        throw std::runtime_error("cannot write " + path);
+    }
+}
+
+SnapshotReader::SnapshotReader(const std::string& path)
+    : path(path), mapped(std::make_shared<MappedFile>(path, true)) {
+    SnapshotHeader header;
+    check(mapped->size() >= sizeof(header), "header");
+    std::memcpy(&header, mapped->data(), sizeof(header));
+    if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0) {
+        throw std::runtime_error(path + " is not a snapshot");
+    }
+    if (header.version != SNAPSHOT_VERSION) {
+        throw std::runtime_error(path + " is a version " + std::to_string(header.version) + " snapshot, expected version " +
+                                 std::to_string(SNAPSHOT_VERSION));
+    }
+    check(header.length == mapped->size(), "length");
+    offset = sizeof(header);
+}
+
+const uint8_t* SnapshotReader::bytes(size_t length) {
+    check(length <= mapped->size() - offset, "section length");
+    const uint8_t* data = mapped->data() + offset;
+    offset += length;
+    return data;
+}
+
+uint8_t* SnapshotReader::region(size_t length) {
+    return const_cast<uint8_t*>(bytes(length));
+}
+
+void SnapshotReader::expectTag(const char* name) {
+    check(std::memcmp(bytes(4), name, 4) == 0, std::string("section ") + name);
+}
+
+void SnapshotReader::alignPage() {
+    bytes((STORE_PAGE_SIZE - offset % STORE_PAGE_SIZE) % STORE_PAGE_SIZE);
+}
+
+void SnapshotReader::check(bool condition, const std::string& what) const {
+    if (!condition) {
+        throw std::runtime_error(path + " is damaged at offset " + std::to_string(offset) + " (" + what + ")");
+    }
+}
+
+SnapshotBucketStore::SnapshotBucketStore(std::shared_ptr<MappedFile> file, uint8_t* records, size_t firstRecord,
+                                         size_t recordCount, size_t recordSize, size_t recordStride)
+    : file(std::move(file)) {
+    base = records;
+    first = firstRecord;
+    size = recordSize;
+    count = recordCount;
+    stride = recordStride;
+#ifndef _WIN32
+    // every record will be touched by the random paths anyway, start reading them in at disk speed now
+    if (recordCount > 0) {
+        ::madvise(records, recordCount * recordStride, MADV_WILLNEED);
+    }
+#endif
+}
+
+std::string SnapshotBucketStore::describe() const {
+    return "snapshot (copy-on-write), " + std::to_string(count) + " records of " + std::to_string(size) +
+           " bytes at a " + std::to_string(stride) + " byte stride";
+}
+
+void saveBucketStore(SnapshotWriter& writer, BucketStore& store) {
+    writer.tag("STOR");
+    writer.value<uint64_t>(store.firstRecord());
+    writer.value<uint64_t>(store.recordCount());
+    writer.value<uint64_t>(store.recordSize());
+    writer.value<uint64_t>(store.recordStride());
+    writer.alignPage();
+    if (store.inPlace()) {
+        if (store.recordCount() > 0) {
+            writer.bytes(store.record(store.firstRecord()), store.recordCount() * store.recordStride());
+        }
+        return;
+    }
+    // fetched in chunks so a large remote store needs no full local copy
+    size_t nodeIDs[512];
+    std::vector<uint8_t> records(512 * store.recordSize());
+    size_t end = store.firstRecord() + store.recordCount();
+    for (size_t first = store.firstRecord(); first < end; first += 512) {
+        size_t length = std::min<size_t>(512, end - first);
+        for (size_t i = 0; i < length; i++) {
+            nodeIDs[i] = first + i;
+        }
+        store.readRecords(nodeIDs, length, records.data());
+        writer.bytes(records.data(), length * store.recordSize());
+    }
+}
+
+std::unique_ptr<BucketStore> loadBucketStore(SnapshotReader& reader, size_t expectedRecordSize) {
+    reader.expectTag("STOR");
+    size_t firstRecord = reader.value<uint64_t>();
+    size_t recordCount = reader.value<uint64_t>();
+    size_t recordSize = reader.value<uint64_t>();
+    size_t recordStride = reader.value<uint64_t>();
+    reader.check(recordSize == expectedRecordSize && recordStride >= recordSize, "record size");
+    reader.check(recordStride == 0 || recordCount <= SIZE_MAX / recordStride, "record count");
+    reader.alignPage();
+    uint8_t* records = reader.region(recordCount * recordStride);
+    return std::make_unique<SnapshotBucketStore>(reader.file(), records, firstRecord, recordCount, recordSize, recordStride);
+}
@@ -0,0 +1,93 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "BucketStore.h"
+#include "StorageFile.h"
+
+// a snapshot is a 32 byte header (magic "PORAMSNP", version, total length) followed by tagged sections in save
+// order, in host byte order like the storage files. Bucket records start at page aligned offsets, so a load
+// maps the file once and the trees use their records in place
+#define SNAPSHOT_MAGIC "PORAMSNP"
+// version 2 added the eviction schedule of each tree, version 3 its ring bucket dummy slots, version 4 its stash bound,
+// version 5 replaced the forest position map by the placement key, version 6 packed the flat position maps,
+// version 7 moved the recursive map labels into block payloads
+#define SNAPSHOT_VERSION 7
+
+// writes a snapshot front to back, any failure throws runtime_error
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(const std::string& path);
+
+    template <typename T>
+    void value(const T& item) {
+        bytes(&item, sizeof(T));
+    }
+    void bytes(const void* data, size_t length);
+    // four character section name, checked again on load
+    void tag(const char* name);
+    // zero padding up to the next STORE_PAGE_SIZE boundary
+    void alignPage();
+    // fills in the header, the file is only a valid snapshot after this
+    void finish();
+
+private:
+    std::string path;
+    std::ofstream output;
+    uint64_t offset = 0;
+};
+
+// reads the sections of a snapshot back in save order from a copy-on-write mapping of the file. A truncated
+// file, a wrong tag or a geometry that does not add up throws runtime_error
+class SnapshotReader {
+public:
+    explicit SnapshotReader(const std::string& path);
+
+    template <typename T>
+    T value() {
+        T item;
+        std::memcpy(&item, bytes(sizeof(T)), sizeof(T));
+        return item;
+    }
+    const uint8_t* bytes(size_t length);
+    // like bytes, but the caller may write the returned range, the changes never reach the file
+    uint8_t* region(size_t length);
+    void expectTag(const char* name);
+    void alignPage();
+    // throws unless condition holds, with what naming the broken field
+    void check(bool condition, const std::string& what) const;
+    const std::shared_ptr<MappedFile>& file() const {
+        return mapped;
+    }
+
+private:
+    std::string path;
+    std::shared_ptr<MappedFile> mapped;
+    size_t offset = 0;
+};
+
+// records of a loaded snapshot, viewed in place. A written record lands on a private copy of its page, the
+// snapshot stays as it was saved and can be loaded again
+class SnapshotBucketStore : public BucketStore {
+public:
+    SnapshotBucketStore(std::shared_ptr<MappedFile> file, uint8_t* records, size_t firstRecord, size_t recordCount,
+                        size_t recordSize, size_t recordStride);
+    std::string describe() const override;
+
+private:
+    std::shared_ptr<MappedFile> file;
+};
+
+// geometry and raw records of a store, whatever its backend. The records keep their stride, a remote store's
+// are fetched and saved like a memory store's
+void saveBucketStore(SnapshotWriter& writer, BucketStore& store);
+std::unique_ptr<BucketStore> loadBucketStore(SnapshotReader& reader, size_t expectedRecordSize);
+
+#endif // SNAPSHOT_H
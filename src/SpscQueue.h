@@ -0,0 +1,57 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+#include "AlignedAllocator.h"
+
+// bounded lock-free ring for exactly one producer thread and one consumer thread
+template <typename T>
+class SpscQueue {
+public:
+    explicit SpscQueue(size_t minCapacity = 1024) : head(0), tail(0) {
+        size_t capacity = 1;
+        while (capacity < minCapacity) {
+            capacity <<= 1;
+        }
+        buffer = std::vector<T>(capacity);
+        mask = capacity - 1;
+    }
+
+    // producer side, returns false when the ring is full
+    bool push(T&& item) {
+        size_t curTail = tail.load(std::memory_order_relaxed);
+        if (curTail - head.load(std::memory_order_acquire) > mask) {
+            return false;
+        }
+        buffer[curTail & mask] = std::move(item);
+        tail.store(curTail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side, returns false when the ring is empty
+    bool pop(T& item) {
+        size_t curHead = head.load(std::memory_order_relaxed);
+        if (curHead == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = std::move(buffer[curHead & mask]);
+        head.store(curHead + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+
+private:
+    std::vector<T> buffer;
+    size_t mask;
+    // producer and consumer indices on separate lines so they do not false share
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> head;
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail;
+};
+
+#endif // SPSC_QUEUE_H
@@ -0,0 +1,309 @@
+#include "StorageFile.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define STORAGE_FILE_MAGIC "PORAMSTO"
+#define OP_TRACE_MAGIC "PORAMOPS"
+#define STORAGE_FILE_VERSION 1
+
+// header of both binary formats, the records follow at offset 32
+struct StorageFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t recordCount;
+    uint64_t padding;
+};
+
+MappedFile::MappedFile(const std::string& path, bool copyOnWrite) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error("cannot open " + path);
+    }
+    LARGE_INTEGER size;
+    GetFileSizeEx(file, &size);
+    length = static_cast<size_t>(size.QuadPart);
+    fileHandle = file;
+    if (length == 0) {
+        return;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, copyOnWrite ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, nullptr);
+    if (mapping != nullptr) {
+        begin = static_cast<const uint8_t*>(MapViewOfFile(mapping, copyOnWrite ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, length));
+    }
+    if (begin == nullptr) {
+        if (mapping != nullptr) {
+            CloseHandle(mapping);
+        }
+        CloseHandle(file);
+        throw std::runtime_error("cannot map " + path);
+    }
+    mappingHandle = mapping;
+#else
+    fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("cannot open " + path);
+    }
+    struct stat status;
+    if (::fstat(fd, &status) != 0) {
+        ::close(fd);
+        throw std::runtime_error("cannot read the size of " + path);
+    }
+    length = static_cast<size_t>(status.st_size);
+    if (length == 0) {
+        return;
+    }
+    void* region = ::mmap(nullptr, length, copyOnWrite ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, fd, 0);
+    if (region == MAP_FAILED) {
+        ::close(fd);
+        throw std::runtime_error("cannot map " + path);
+    }
+    begin = static_cast<const uint8_t*>(region);
+    if (!copyOnWrite) {
+        // input files are read once front to back
+        ::madvise(region, length, MADV_SEQUENTIAL);
+    }
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifdef _WIN32
+    if (begin != nullptr) {
+        UnmapViewOfFile(begin);
+        CloseHandle(static_cast<HANDLE>(mappingHandle));
+    }
+    CloseHandle(static_cast<HANDLE>(fileHandle));
+#else
+    if (begin != nullptr) {
+        ::munmap(const_cast<uint8_t*>(begin), length);
+    }
+    ::close(fd);
+#endif
+}
+
+// record count of a binary file with the given magic, or nullopt when the file is not one
+static std::optional<size_t> binaryRecords(const MappedFile& file, const char* magic, size_t recordSize) {
+    if (file.size() < sizeof(StorageFileHeader) || std::memcmp(file.data(), magic, 8) != 0) {
+        return std::nullopt;
+    }
+    StorageFileHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (header.version != STORAGE_FILE_VERSION || header.recordCount > (file.size() - sizeof(header)) / recordSize) {
+        return std::nullopt;
+    }
+    return header.recordCount;
+}
+
+StorageFile::StorageFile(const std::string& path) : file(path) {
+    std::optional<size_t> records = binaryRecords(file, STORAGE_FILE_MAGIC, sizeof(StorageRecord));
+    if (!records.has_value()) {
+        throw std::runtime_error(path + " is not a version " + std::to_string(STORAGE_FILE_VERSION) + " storage file");
+    }
+    begin = reinterpret_cast<const StorageRecord*>(file.data() + sizeof(StorageFileHeader));
+    count = records.value();
+}
+
+OpTrace::OpTrace(const std::string& path) : begin(nullptr), count(0) {
+    file.emplace(path);
+    if (file->size() >= 8 && std::memcmp(file->data(), OP_TRACE_MAGIC, 8) == 0) {
+        std::optional<size_t> records = binaryRecords(*file, OP_TRACE_MAGIC, sizeof(TraceOp));
+        if (!records.has_value()) {
+            throw std::runtime_error(path + " is not a version " + std::to_string(STORAGE_FILE_VERSION) + " op trace");
+        }
+        begin = reinterpret_cast<const TraceOp*>(file->data() + sizeof(StorageFileHeader));
+        count = records.value();
+        for (size_t i = 0; i < count; i++) {
+            if (begin[i].op > TRACE_WRITE) {
+                throw std::runtime_error(path + " has an unknown operation in record " + std::to_string(i));
+            }
+        }
+        return;
+    }
+    tokenize(reinterpret_cast<const char*>(file->data()), file->size());
+    // the text is not needed once it is tokenized
+    file.reset();
+    begin = parsed.data();
+    count = parsed.size();
+}
+
+static inline bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static inline const char* skipBlanks(const char* cursor, const char* end) {
+    while (cursor < end && isBlank(*cursor)) {
+        cursor++;
+    }
+    return cursor;
+}
+
+// unsigned decimal, false when no digit is found or it overflows
+static bool parsePosition(const char*& cursor, const char* end, uint64_t& out) {
+    cursor = skipBlanks(cursor, end);
+    const char* start = cursor;
+    uint64_t value = 0;
+    while (cursor < end && *cursor >= '0' && *cursor <= '9') {
+        uint64_t digit = static_cast<uint64_t>(*cursor - '0');
+        if (value > (UINT64_MAX - digit) / 10) {
+            return false;
+        }
+        value = value * 10 + digit;
+        cursor++;
+    }
+    out = value;
+    return cursor != start;
+}
+
+// optionally signed decimal that fits an int
+static bool parseValue(const char*& cursor, const char* end, int32_t& out) {
+    cursor = skipBlanks(cursor, end);
+    bool negative = false;
+    if (cursor < end && (*cursor == '-' || *cursor == '+')) {
+        negative = *cursor == '-';
+        cursor++;
+    }
+    uint64_t magnitude;
+    if (!parsePosition(cursor, end, magnitude) || magnitude > static_cast<uint64_t>(INT32_MAX) + (negative ? 1 : 0)) {
+        return false;
+    }
+    out = negative ? static_cast<int32_t>(-static_cast<int64_t>(magnitude)) : static_cast<int32_t>(magnitude);
+    return true;
+}
+
+// one pass over the mapped text, malformed lines are reported like the line based reader did and skipped
+void OpTrace::tokenize(const char* text, size_t length) {
+    const char* end = text + length;
+    const char* lineStart = text;
+    while (lineStart < end) {
+        const char* lineEnd = static_cast<const char*>(std::memchr(lineStart, '\n', end - lineStart));
+        if (lineEnd == nullptr) {
+            lineEnd = end;
+        }
+        const char* cursor = skipBlanks(lineStart, lineEnd);
+        const char* tokenEnd = cursor;
+        while (tokenEnd < lineEnd && !isBlank(*tokenEnd)) {
+            tokenEnd++;
+        }
+        std::string_view token(cursor, tokenEnd - cursor);
+        std::string_view line(lineStart, lineEnd - lineStart);
+        if (!token.empty()) {
+            cursor = tokenEnd;
+            TraceOp op = {0, 0, TRACE_READ};
+            if (token == "R") {
+                if (parsePosition(cursor, lineEnd, op.position)) {
+                    parsed.push_back(op);
+                } else {
+                    std::cerr << "Invalid read operation format: " << line << std::endl;
+                }
+            } else if (token == "W") {
+                op.op = TRACE_WRITE;
+                if (parsePosition(cursor, lineEnd, op.position) && parseValue(cursor, lineEnd, op.value)) {
+                    parsed.push_back(op);
+                } else {
+                    std::cerr << "Invalid write operation format: " << line << std::endl;
+                }
+            } else {
+                std::cerr << "Unknown operation: " << token << " in line: " << line << std::endl;
+            }
+        }
+        lineStart = lineEnd + 1;
+    }
+}
+
+bool isStorageFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    char magic[8];
+    return file.read(magic, sizeof(magic)) && std::memcmp(magic, STORAGE_FILE_MAGIC, sizeof(magic)) == 0;
+}
+
+// header with a zero count first, patched once the records are written
+static std::optional<std::ofstream> openBinary(const std::string& binaryPath, StorageFileHeader& header, const char* magic) {
+    std::ofstream output(binaryPath, std::ios::binary | std::ios::trunc);
+    if (!output) {
+        std::cerr << "Error opening file: " << binaryPath << std::endl;
+        return std::nullopt;
+    }
+    header = {};
+    std::memcpy(header.magic, magic, sizeof(header.magic));
+    header.version = STORAGE_FILE_VERSION;
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    return output;
+}
+
+static std::optional<size_t> closeBinary(std::ofstream& output, const StorageFileHeader& header, const std::string& binaryPath) {
+    output.seekp(0);
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (!output) {
+        std::cerr << "Error writing file: " << binaryPath << std::endl;
+        return std::nullopt;
+    }
+    return header.recordCount;
+}
+
+std::optional<size_t> convertStorageFile(const std::string& textPath, const std::string& binaryPath) {
+    std::ifstream input(textPath);
+    if (!input) {
+        std::cerr << "Error opening file: " << textPath << std::endl;
+        return std::nullopt;
+    }
+    StorageFileHeader header;
+    std::optional<std::ofstream> output = openBinary(binaryPath, header, STORAGE_FILE_MAGIC);
+    if (!output.has_value()) {
+        return std::nullopt;
+    }
+    // same rules as the text loader: lines that do not start with two integers are skipped
+    std::string line;
+    size_t skipped = 0;
+    while (std::getline(input, line)) {
+        std::istringstream lineStream(line);
+        long long position;
+        int value;
+        if (!(lineStream >> position >> value)) {
+            continue;
+        }
+        if (position < 0) {
+            skipped++;
+            continue;
+        }
+        StorageRecord record = {static_cast<uint64_t>(position), value, 0};
+        output->write(reinterpret_cast<const char*>(&record), sizeof(record));
+        header.recordCount++;
+    }
+    if (skipped > 0) {
+        std::cerr << "Skipped " << skipped << " entries with a negative position." << std::endl;
+    }
+    return closeBinary(*output, header, binaryPath);
+}
+
+std::optional<size_t> convertOpFile(const std::string& textPath, const std::string& binaryPath) {
+    std::optional<OpTrace> trace;
+    try {
+        trace.emplace(textPath);
+    } catch (const std::exception& e) {
+        std::cerr << "Error opening file: " << e.what() << std::endl;
+        return std::nullopt;
+    }
+    StorageFileHeader header;
+    std::optional<std::ofstream> output = openBinary(binaryPath, header, OP_TRACE_MAGIC);
+    if (!output.has_value()) {
+        return std::nullopt;
+    }
+    output->write(reinterpret_cast<const char*>(trace->ops()), trace->size() * sizeof(TraceOp));
+    header.recordCount = trace->size();
+    return closeBinary(*output, header, binaryPath);
+}
@@ -0,0 +1,107 @@
+#ifndef STORAGE_FILE_H
+#define STORAGE_FILE_H
+
+#include <string>
+#include <vector>
+#include <optional>
+#include <cstdint>
+#include <cstddef>
+
+// one entry of a binary storage file, 16 bytes so the records stay aligned in the mapping
+struct StorageRecord {
+    uint64_t position;
+    int32_t value;
+    uint32_t reserved;
+};
+
+// op values of a trace, the same numbering as Operation
+#define TRACE_READ 0
+#define TRACE_WRITE 1
+
+// one operation of an op trace
+struct TraceOp {
+    uint64_t position;
+    int32_t value;
+    uint32_t op;
+};
+
+// whole file mapped read-only, or copy-on-write: then the pages can be written but the changes stay private to
+// this process and never reach the file
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path, bool copyOnWrite = false);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* data() const {
+        return begin;
+    }
+    // copy-on-write mappings only
+    uint8_t* writableData() const {
+        return const_cast<uint8_t*>(begin);
+    }
+    size_t size() const {
+        return length;
+    }
+
+private:
+    const uint8_t* begin = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#else
+    int fd = -1;
+#endif
+};
+
+// binary storage file: a 32 byte header (magic "PORAMSTO", version, record count) followed by the records,
+// so loading one needs no parsing at all
+class StorageFile {
+public:
+    explicit StorageFile(const std::string& path);
+
+    const StorageRecord* records() const {
+        return begin;
+    }
+    size_t size() const {
+        return count;
+    }
+
+private:
+    MappedFile file;
+    const StorageRecord* begin;
+    size_t count;
+};
+
+// the operations of an op file, ready to run. A binary trace ("PORAMOPS" header, then TraceOp records) is used
+// in place, a text file (R <position> or W <position> <value> per line) is tokenized once into an owned array
+class OpTrace {
+public:
+    explicit OpTrace(const std::string& path);
+
+    const TraceOp* ops() const {
+        return begin;
+    }
+    size_t size() const {
+        return count;
+    }
+
+private:
+    std::optional<MappedFile> file;
+    std::vector<TraceOp> parsed;
+    const TraceOp* begin;
+    size_t count;
+
+    void tokenize(const char* text, size_t length);
+};
+
+// true when path starts with the binary storage magic
+bool isStorageFile(const std::string& path);
+// converts a text storage file (<position> <value> per line) to the binary format, returns the record count
+std::optional<size_t> convertStorageFile(const std::string& textPath, const std::string& binaryPath);
+// converts a text op file to a binary op trace, returns the op count
+std::optional<size_t> convertOpFile(const std::string& textPath, const std::string& binaryPath);
+
+#endif // STORAGE_FILE_H
@@ -1,11 +1,16 @@
 #include "Tree.h"
 #include "rgen.h"
+#include "RemoteStore.h"
 
+#include <algorithm>
+#include <cstring>
+#include <functional>
 
-Block::Block() : value(randomSizeT(0, INT_MAX)), originalPosition(randomSizeT(0, INT_MAX)), isDummy(true) {}
+
+Block::Block() : originalPosition(0), value(0), leaf(0), isDummy(true) {}
 
 Block::Block(int value, size_t originalPosition, bool isDummy) 
-    : value(value), originalPosition(originalPosition), isDummy(isDummy) {}
+    : originalPosition(originalPosition), value(value), leaf(0), isDummy(isDummy) {}
 
 std::string Block::toString() const {
     if (isDummy) {
@@ -14,42 +19,55 @@ std::string Block::toString() const {
     return "[Pos:" + std::to_string(originalPosition) + ", Val:" + std::to_string(value) + "]";
 }
 
-Node::Node(size_t bucketSize) : buckets(bucketSize, Block(randomSizeT(0, INT_MAX), randomSizeT(0, INT_MAX), true)), occupied(0), size(bucketSize) {}
+Node::Node(Block* buckets, uint32_t& occupied, size_t size, uint8_t* payloads, size_t payloadSize, uint8_t* slots)
+    : buckets(buckets), occupied(occupied), size(size), payloads(payloads), payloadSize(payloadSize), slots(slots) {}
 
+// real blocks always sit in buckets[0, occupied), every slot past that is an implicit dummy
 void Node::clear() {
-    for (auto& block : buckets) {
-        block = Block(randomSizeT(0, INT_MAX),randomSizeT(0, INT_MAX), true);
-    }
     occupied = 0;
 }
 
 
 void Node::deFrag() {
-    std::vector<Block> newBckets;
-    for (const auto& block : buckets) {
-        if (!block.isDummy) {
-            newBckets.push_back(block);
+    // compact the blocks still real after a partial read to the front, keeping their order
+    size_t next = 0;
+    for (size_t i = 0; i < occupied; i++) {
+        if (!buckets[i].isDummy) {
+            if (i != next) {
+                buckets[next] = std::move(buckets[i]);
+                std::memcpy(payload(next), payload(i), payloadSize);
+                if (slots != nullptr) {
+                    slots[next] = slots[i];
+                }
+            }
+            next++;
         }
     }
-    occupied = newBckets.size();
-    for (size_t i = occupied; i < size; i++) {
-        newBckets.push_back(Block(randomSizeT(0, INT_MAX), randomSizeT(0, INT_MAX), true));
-    }
-    buckets = std::move(newBckets);
+    occupied = next;
 }
 
-void Node::put(Block& block) {
+void Node::put(Block& block, const uint8_t* payload) {
     if (occupied >= size) {
         throw std::runtime_error("buckets is full");
     } else {
         buckets[occupied] = std::move(block);
+        if (payload != nullptr) {
+            std::memcpy(this->payload(occupied), payload, payloadSize);
+        } else {
+            std::memset(this->payload(occupied), 0, payloadSize);
+        }
         occupied++;
     }
 }
 
 void Node::remove(size_t index) {
     if (index < occupied) {
-        buckets[index] = Block();
+        // the last real block fills the hole so the real blocks stay packed
+        buckets[index] = std::move(buckets[occupied - 1]);
+        std::memcpy(payload(index), payload(occupied - 1), payloadSize);
+        if (slots != nullptr) {
+            slots[index] = slots[occupied - 1];
+        }
         occupied--;
     } else {
         throw std::out_of_range("Invalid index");
@@ -58,17 +76,136 @@ void Node::remove(size_t index) {
 
 
 
-std::string Node::toString() const {
+static std::string bucketToString(const Block* buckets, uint32_t occupied, size_t size) {
     std::string result = "Node(occupied:" + std::to_string(occupied) + "/" + std::to_string(size) + ") [";
-    for (size_t i = 0; i < buckets.size(); i++) {
+    for (size_t i = 0; i < size; i++) {
         if (i > 0) result += ", ";
-        result += buckets[i].toString();
+        result += i < occupied ? buckets[i].toString() : "[DUMMY]";
     }
     result += "]";
     return result;
 }
 
-Tree::Tree(size_t dataSize, size_t bucketSize, std::optional<int> preDesignedCap) {
+std::string Node::toString() const {
+    return bucketToString(buckets, occupied, size);
+}
+
+// 1024 leaf prefix buckets, the non-empty bitmap is 16 words
+#define STASH_PREFIX_BITS 10
+
+Stash::Stash(size_t leafDepth, size_t payloadSize) : payloadSize(payloadSize), index(256) {
+    size_t prefixBits = std::min<size_t>(leafDepth, STASH_PREFIX_BITS);
+    leafShift = leafDepth - prefixBits;
+    bucketHead.assign(size_t(1) << prefixBits, NO_SLOT);
+    nonEmpty.assign((bucketHead.size() + 63) / 64, 0);
+}
+
+void Stash::reserve(size_t capacity) {
+    blocks.reserve(capacity);
+    payloads.reserve(capacity * payloadSize);
+    bucketNext.reserve(capacity);
+    bucketPrev.reserve(capacity);
+    index.reserve(capacity);
+}
+
+Block* Stash::find(size_t position) {
+    size_t slot = index.find(position);
+    return slot == FlatIndex::NOT_FOUND ? nullptr : &blocks[slot];
+}
+
+Block& Stash::add(Block&& block, const uint8_t* payload) {
+    size_t slot = blocks.size();
+    blocks.push_back(std::move(block));
+    if (payloadSize > 0) {
+        payloads.resize(blocks.size() * payloadSize);
+        if (payload != nullptr) {
+            std::memcpy(&payloads[slot * payloadSize], payload, payloadSize);
+        } else {
+            std::memset(&payloads[slot * payloadSize], 0, payloadSize);
+        }
+    }
+    bucketNext.push_back(NO_SLOT);
+    bucketPrev.push_back(NO_SLOT);
+    index.insert(blocks[slot].originalPosition, slot);
+    link(slot);
+    return blocks[slot];
+}
+
+void Stash::relabel(Block* block, size_t leaf) {
+    size_t slot = block - blocks.data();
+    unlink(slot);
+    block->leaf = leaf;
+    link(slot);
+}
+
+void Stash::link(size_t slot) {
+    size_t bucket = blocks[slot].leaf >> leafShift;
+    size_t head = bucketHead[bucket];
+    bucketPrev[slot] = NO_SLOT;
+    bucketNext[slot] = head;
+    if (head != NO_SLOT) {
+        bucketPrev[head] = slot;
+    }
+    bucketHead[bucket] = slot;
+    nonEmpty[bucket / 64] |= uint64_t(1) << (bucket % 64);
+}
+
+void Stash::unlink(size_t slot) {
+    size_t bucket = blocks[slot].leaf >> leafShift;
+    size_t prev = bucketPrev[slot];
+    size_t next = bucketNext[slot];
+    if (prev != NO_SLOT) {
+        bucketNext[prev] = next;
+    } else {
+        bucketHead[bucket] = next;
+        if (next == NO_SLOT) {
+            nonEmpty[bucket / 64] &= ~(uint64_t(1) << (bucket % 64));
+        }
+    }
+    if (next != NO_SLOT) {
+        bucketPrev[next] = prev;
+    }
+}
+
+// swap with the last slot and pop, so the dense vector never has holes
+void Stash::removeSlot(size_t slot) {
+    unlink(slot);
+    index.erase(blocks[slot].originalPosition);
+    size_t last = blocks.size() - 1;
+    if (slot != last) {
+        blocks[slot] = std::move(blocks[last]);
+        if (payloadSize > 0) {
+            std::memcpy(&payloads[slot * payloadSize], &payloads[last * payloadSize], payloadSize);
+        }
+        size_t prev = bucketPrev[last];
+        size_t next = bucketNext[last];
+        bucketPrev[slot] = prev;
+        bucketNext[slot] = next;
+        if (prev != NO_SLOT) {
+            bucketNext[prev] = slot;
+        } else {
+            bucketHead[blocks[slot].leaf >> leafShift] = slot;
+        }
+        if (next != NO_SLOT) {
+            bucketPrev[next] = slot;
+        }
+        index.insert(blocks[slot].originalPosition, slot);
+    }
+    blocks.pop_back();
+    payloads.resize(blocks.size() * payloadSize);
+    bucketNext.pop_back();
+    bucketPrev.pop_back();
+}
+
+// a remote store when the tree is configured with a bucket server, otherwise a local one
+static std::unique_ptr<BucketStore> openStore(const TreeConfig& config, size_t firstRecord, size_t recordCount, size_t recordSize) {
+    if (!config.serverSocket.empty()) {
+        return std::make_unique<RemoteBucketStore>(config.serverSocket, firstRecord, recordCount, recordSize);
+    }
+    return makeBucketStore(config.storePath, firstRecord, recordCount, recordSize);
+}
+
+Tree::Tree(size_t dataSize, size_t bucketSize, std::optional<int> preDesignedCap, const TreeConfig& config) : bucketSize(bucketSize), config(config) {
     size_t size = 0;
     size_t nodeCount = (dataSize + bucketSize - 1) / bucketSize;
     treeLevel = 0;
@@ -82,10 +219,46 @@ Tree::Tree(size_t dataSize, size_t bucketSize, std::optional<int> preDesignedCap
     //*according section 7.1 Stash Occupancy Distribution in the paper
     if ((double)size < dataSize * 1.1) {
         size = (size << 1) | 1;
+        treeLevel++;
     }
 
-    for (size_t i = 0; i < size; i ++) {
-        nodes.emplace_back(Node(bucketSize));
+    this->nodeCount = size;
+    payloadSize = config.payloadSize;
+    if (config.dummySlots > 0) {
+        if (config.evictionRate == 0) {
+            throw std::runtime_error("ring buckets need scheduled eviction");
+        }
+        if (config.cipher != CipherKind::NONE) {
+            throw std::runtime_error("ring buckets are only read one slot at a time, they cannot be sealed as a whole");
+        }
+        if (bucketSize + config.dummySlots > 64) {
+            throw std::runtime_error("a ring bucket has at most 64 slots");
+        }
+        if (!config.serverSocket.empty()) {
+            throw std::runtime_error("ring buckets read single slots in place, they cannot live on a bucket server");
+        }
+    }
+    if (config.stashLimit > 0 && config.stashWatermark > config.stashLimit) {
+        throw std::runtime_error("the stash watermark is above the stash limit");
+    }
+    stash = Stash(treeLevel - 1, payloadSize);
+    recordSize = BUCKET_HEADER_SIZE + bucketSize * (sizeof(Block) + payloadSize) + (config.dummySlots > 0 ? bucketSize : 0);
+    topCacheNodes = (size_t(1) << std::min(config.topCacheLevels, treeLevel)) - 1;
+    topCache = std::vector<uint8_t, AlignedAllocator<uint8_t>>(topCacheNodes * recordSize, 0);
+    if (config.cipher == CipherKind::NONE) {
+        // zeroed records are empty buckets, so a new store needs no initialisation pass
+        store = openStore(config, topCacheNodes, size - topCacheNodes, recordSize);
+        staging = !store->inPlace();
+    } else {
+        cipher = std::make_unique<BucketCipher>(config.cipher, recordSize);
+        store = openStore(config, topCacheNodes, size - topCacheNodes, cipher->sealedSize());
+        staging = true;
+        // every stored bucket starts as a sealed empty record
+        std::vector<uint8_t, AlignedAllocator<uint8_t>> empty(recordSize, 0);
+        writeStore(empty.data(), 0);
+        // the stats only cover accesses
+        cipher->sealedBuckets = 0;
+        cipher->nanoseconds = 0;
     }
     if (preDesignedCap.has_value()) {
         capacity = preDesignedCap.value();
@@ -96,7 +269,328 @@ Tree::Tree(size_t dataSize, size_t bucketSize, std::optional<int> preDesignedCap
     ringPath = 0;
     leafStartIndex = size/2;
     mid = leafCount/2 + leafStartIndex;
-    positionMap = std::vector<std::optional<size_t>>(dataSize + 1, std::nullopt);
+    positionMap = PositionMap(dataSize + 1, leafCount, bucketSize, config);
+    reserveScratch(1);
+}
+
+Tree::Tree(SnapshotReader& reader) {
+    reader.expectTag("TREE");
+    nodeCount = reader.value<uint64_t>();
+    bucketSize = reader.value<uint64_t>();
+    capacity = reader.value<uint64_t>();
+    occupied = reader.value<uint64_t>();
+    ringPath = reader.value<uint64_t>();
+    maxStashSize = reader.value<uint64_t>();
+    payloadSize = reader.value<uint64_t>();
+    config.topCacheLevels = reader.value<uint64_t>();
+    config.evictionRate = reader.value<uint64_t>();
+    config.reshuffleReads = reader.value<uint64_t>();
+    config.dummySlots = reader.value<uint64_t>();
+    config.stashLimit = reader.value<uint64_t>();
+    config.stashWatermark = reader.value<uint64_t>();
+    pendingAccesses = reader.value<uint64_t>();
+    uint64_t posMapBudget = reader.value<uint64_t>();
+    uint32_t cipherKind = reader.value<uint32_t>();
+    if (reader.value<uint32_t>() != 0) {
+        config.posMapBudget = posMapBudget;
+    }
+    // a full tree of at most MAX_TREE_LEVEL levels
+    reader.check(nodeCount > 0 && (nodeCount & (nodeCount + 1)) == 0 && nodeCount < (size_t(1) << (MAX_TREE_LEVEL - 1)), "node count");
+    reader.check(bucketSize > 0 && bucketSize <= UINT32_MAX && payloadSize <= UINT32_MAX, "bucket size");
+    reader.check(cipherKind <= static_cast<uint32_t>(CipherKind::AES_256_GCM), "cipher");
+    reader.check(config.stashLimit == 0 || config.stashWatermark <= config.stashLimit, "stash bound");
+    reader.check(config.dummySlots == 0 || (config.evictionRate > 0 && cipherKind == 0 && bucketSize + config.dummySlots <= 64), "ring buckets");
+    treeLevel = 0;
+    while ((size_t(1) << treeLevel) - 1 < nodeCount) {
+        treeLevel++;
+    }
+    leafCount = nodeCount / 2 + 1;
+    leafStartIndex = nodeCount / 2;
+    mid = leafCount / 2 + leafStartIndex;
+    ringPath %= leafCount;
+    reader.check(pendingAccesses < std::max<size_t>(config.evictionRate, 1), "eviction schedule");
+    config.cipher = static_cast<CipherKind>(cipherKind);
+    config.payloadSize = payloadSize;
+    recordSize = BUCKET_HEADER_SIZE + bucketSize * (sizeof(Block) + payloadSize) + (config.dummySlots > 0 ? bucketSize : 0);
+    topCacheNodes = (size_t(1) << std::min(config.topCacheLevels, treeLevel)) - 1;
+    if (config.cipher != CipherKind::NONE) {
+        cipher = std::make_unique<BucketCipher>(config.cipher, recordSize, reader.bytes(BUCKET_KEY_SIZE));
+    }
+    const uint8_t* cached = reader.bytes(topCacheNodes * recordSize);
+    topCache.assign(cached, cached + topCacheNodes * recordSize);
+
+    stash = Stash(treeLevel - 1, payloadSize);
+    size_t stashCount = reader.value<uint64_t>();
+    reader.check(stashCount <= nodeCount * bucketSize + leafCount, "stash size");
+    const uint8_t* blocks = reader.bytes(stashCount * sizeof(Block));
+    const uint8_t* payloads = reader.bytes(stashCount * payloadSize);
+    for (size_t i = 0; i < stashCount; i++) {
+        Block block;
+        std::memcpy(&block, blocks + i * sizeof(Block), sizeof(Block));
+        reader.check(block.leaf < leafCount, "stash block");
+        stash.add(std::move(block), payloads + i * payloadSize);
+    }
+
+    // a tree saved from a bucket server comes back with its records local
+    store = loadBucketStore(reader, cipher ? cipher->sealedSize() : recordSize);
+    reader.check(store->firstRecord() == topCacheNodes && store->recordCount() == nodeCount - topCacheNodes, "store geometry");
+    staging = cipher != nullptr;
+    positionMap = PositionMap(reader, leafCount);
+    // records used in place are checked once here, sealed ones are checked as they are opened
+    for (size_t nodeID = 0; nodeID < (cipher ? topCacheNodes : nodeCount); nodeID++) {
+        reader.check(validRecord(record(nodeID)), "bucket " + std::to_string(nodeID));
+    }
+    for (const Block& block : stash) {
+        reader.check(block.originalPosition < positionMap.size() && stash.find(block.originalPosition) == &block, "stash block");
+    }
+    reserveScratch(1);
+}
+
+void Tree::save(SnapshotWriter& writer) const {
+    writer.tag("TREE");
+    writer.value<uint64_t>(nodeCount);
+    writer.value<uint64_t>(bucketSize);
+    writer.value<uint64_t>(capacity);
+    writer.value<uint64_t>(occupied);
+    writer.value<uint64_t>(ringPath);
+    writer.value<uint64_t>(maxStashSize);
+    writer.value<uint64_t>(payloadSize);
+    writer.value<uint64_t>(config.topCacheLevels);
+    writer.value<uint64_t>(config.evictionRate);
+    writer.value<uint64_t>(config.reshuffleReads);
+    writer.value<uint64_t>(config.dummySlots);
+    writer.value<uint64_t>(config.stashLimit);
+    writer.value<uint64_t>(config.stashWatermark);
+    writer.value<uint64_t>(pendingAccesses);
+    writer.value<uint64_t>(config.posMapBudget.value_or(0));
+    writer.value<uint32_t>(static_cast<uint32_t>(config.cipher));
+    writer.value<uint32_t>(config.posMapBudget.has_value() ? 1 : 0);
+    if (cipher) {
+        // the key is client state like the stash, whoever holds the snapshot can open the buckets
+        writer.bytes(cipher->keyBytes(), BUCKET_KEY_SIZE);
+    }
+    writer.bytes(topCache.data(), topCache.size());
+    writer.value<uint64_t>(stash.size());
+    for (const Block& block : stash) {
+        writer.value(block);
+    }
+    if (payloadSize > 0) {
+        for (const Block& block : stash) {
+            writer.bytes(stash.payload(&block), payloadSize);
+        }
+    }
+    saveBucketStore(writer, *store);
+    positionMap.save(writer);
+}
+
+// writes the plaintext record plains + (nodeID - topCacheNodes) * plainStride to every store record, sealed when
+// there is a cipher, in path sized chunks like any write-back. A plain remote store takes the records as they are,
+// which needs plainStride == recordSize
+void Tree::writeStore(const uint8_t* plains, size_t plainStride) {
+    bool remote = !store->inPlace();
+    for (size_t first = topCacheNodes; first < nodeCount; first += MAX_TREE_LEVEL) {
+        cipherNodes.clear();
+        for (size_t nodeID = first; nodeID < nodeCount && nodeID < first + MAX_TREE_LEVEL; nodeID++) {
+            cipherNodes.push_back(nodeID);
+        }
+        if (!cipher) {
+            store->writeRecords(cipherNodes.data(), cipherNodes.size(), plains + (first - topCacheNodes) * plainStride);
+            continue;
+        }
+        if (remote && wireRecords.size() < cipherNodes.size() * store->recordSize()) {
+            wireRecords.resize(cipherNodes.size() * store->recordSize());
+        }
+        cipherPlains.clear();
+        cipherSealed.clear();
+        for (size_t i = 0; i < cipherNodes.size(); i++) {
+            cipherPlains.push_back(const_cast<uint8_t*>(plains + (cipherNodes[i] - topCacheNodes) * plainStride));
+            cipherSealed.push_back(remote ? &wireRecords[i * store->recordSize()] : store->record(cipherNodes[i]));
+        }
+        cipher->sealBatch(cipherPlains.data(), cipherSealed.data(), cipherNodes.data(), cipherNodes.size());
+        if (remote) {
+            store->writeRecords(cipherNodes.data(), cipherNodes.size(), wireRecords.data());
+        }
+    }
+}
+
+static inline Node recordNode(uint8_t* record, size_t bucketSize, size_t payloadSize, bool ring = false) {
+    uint8_t* payloads = record + BUCKET_HEADER_SIZE + bucketSize * sizeof(Block);
+    return Node(reinterpret_cast<Block*>(record + BUCKET_HEADER_SIZE), *reinterpret_cast<uint32_t*>(record), bucketSize,
+                payloads, payloadSize, ring ? payloads + bucketSize * payloadSize : nullptr);
+}
+
+bool Tree::validRecord(uint8_t* record) const {
+    Node cur = recordNode(record, bucketSize, payloadSize, config.dummySlots > 0);
+    if (cur.occupied > bucketSize) {
+        return false;
+    }
+    for (size_t i = 0; i < cur.occupied; i++) {
+        const Block& block = cur.buckets[i];
+        if (block.leaf >= leafCount || block.originalPosition >= positionMap.size() ||
+            (cur.slots != nullptr && cur.slots[i] >= bucketSize + config.dummySlots)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint8_t* Tree::record(size_t nodeID) {
+    if (nodeID < topCacheNodes) {
+        return &topCache[nodeID * recordSize];
+    }
+    if (staging) {
+        size_t index = stagedIndex.find(nodeID);
+        if (index == FlatIndex::NOT_FOUND) {
+            throw std::logic_error("bucket " + std::to_string(nodeID) + " used before it was staged");
+        }
+        return &stagedRecords[index * recordSize];
+    }
+    return store->record(nodeID);
+}
+
+Node Tree::node(size_t nodeID) {
+    return recordNode(record(nodeID), bucketSize, payloadSize, config.dummySlots > 0);
+}
+
+uint32_t& Tree::bucketReads(size_t nodeID) {
+    return *reinterpret_cast<uint32_t*>(record(nodeID) + BUCKET_READS_OFFSET);
+}
+
+uint64_t& Tree::usedSlots(size_t nodeID) {
+    return *reinterpret_cast<uint64_t*>(record(nodeID) + BUCKET_USED_SLOTS_OFFSET);
+}
+
+void Tree::stageNodes(const size_t* nodeIDs, size_t count) {
+    size_t first = stagedNodes.size();
+    for (size_t i = 0; i < count; i++) {
+        // cached top levels are already plaintext on the client
+        if (nodeIDs[i] >= topCacheNodes && stagedIndex.find(nodeIDs[i]) == FlatIndex::NOT_FOUND) {
+            stagedIndex.insert(nodeIDs[i], stagedNodes.size());
+            stagedNodes.push_back(nodeIDs[i]);
+        }
+    }
+    if (stagedNodes.size() == first) {
+        return;
+    }
+    if (stagedRecords.size() < stagedNodes.size() * recordSize) {
+        stagedRecords.resize(stagedNodes.size() * recordSize);
+    }
+    size_t fresh = stagedNodes.size() - first;
+    bool remote = !store->inPlace();
+    if (!cipher) {
+        // plaintext records come off the wire straight into their staging slots
+        store->readRecords(&stagedNodes[first], fresh, &stagedRecords[first * recordSize]);
+        checkStaged(first);
+        return;
+    }
+    if (remote) {
+        // one request for every sealed record the batch needs
+        if (wireRecords.size() < fresh * store->recordSize()) {
+            wireRecords.resize(fresh * store->recordSize());
+        }
+        store->readRecords(&stagedNodes[first], fresh, wireRecords.data());
+    }
+    cipherPlains.clear();
+    cipherSealed.clear();
+    for (size_t index = first; index < stagedNodes.size(); index++) {
+        cipherPlains.push_back(&stagedRecords[index * recordSize]);
+        cipherSealed.push_back(remote ? &wireRecords[(index - first) * store->recordSize()] : store->record(stagedNodes[index]));
+    }
+    if (!cipher->openBatch(cipherSealed.data(), cipherPlains.data(), &stagedNodes[first], stagedNodes.size() - first)) {
+        throw std::runtime_error("bucket failed authentication, the sealed tree was modified");
+    }
+    checkStaged(first);
+}
+
+void Tree::checkStaged(size_t first) {
+    for (size_t index = first; index < stagedNodes.size(); index++) {
+        if (!validRecord(&stagedRecords[index * recordSize])) {
+            throw std::runtime_error("bucket " + std::to_string(stagedNodes[index]) + " does not hold a valid record");
+        }
+    }
+}
+
+void Tree::flushStaged() {
+    if (stagedNodes.empty()) {
+        return;
+    }
+    // slots past a bucket's occupancy may still hold blocks that moved out, they are sealed with the rest
+    // and never read back as real, so no dummy fill is needed
+    bool remote = !store->inPlace();
+    if (!cipher) {
+        store->writeRecords(stagedNodes.data(), stagedNodes.size(), stagedRecords.data());
+    } else {
+        if (remote && wireRecords.size() < stagedNodes.size() * store->recordSize()) {
+            wireRecords.resize(stagedNodes.size() * store->recordSize());
+        }
+        cipherPlains.clear();
+        cipherSealed.clear();
+        for (size_t index = 0; index < stagedNodes.size(); index++) {
+            cipherPlains.push_back(&stagedRecords[index * recordSize]);
+            cipherSealed.push_back(remote ? &wireRecords[index * store->recordSize()] : store->record(stagedNodes[index]));
+        }
+        cipher->sealBatch(cipherPlains.data(), cipherSealed.data(), stagedNodes.data(), stagedNodes.size());
+        if (remote) {
+            store->writeRecords(stagedNodes.data(), stagedNodes.size(), wireRecords.data());
+        }
+    }
+    stagedNodes.clear();
+    stagedIndex.clear();
+}
+
+CryptoStats Tree::getCryptoStats() const {
+    CryptoStats stats = positionMap.getCryptoStats();
+    if (cipher) {
+        stats.sealedBuckets += cipher->sealedBuckets;
+        stats.openedBuckets += cipher->openedBuckets;
+        stats.nanoseconds += cipher->nanoseconds;
+    }
+    return stats;
+}
+
+BucketTransferStats Tree::getTransferStats() const {
+    BucketTransferStats stats = positionMap.getTransferStats();
+    stats.accesses += accessCount;
+    stats.storeBuckets += storeTransfers;
+    stats.cachedBuckets += cachedTransfers;
+    stats.storeSlots += storeSlotReads;
+    // a single slot read also fetches the bucket's header and slot map
+    size_t slotBytes = sizeof(Block) + payloadSize;
+    size_t slotReadBytes = BUCKET_HEADER_SIZE + bucketSize + slotBytes;
+    stats.storeBytes += storeTransfers * store->recordSize() + storeSlotReads * slotReadBytes + dummySlotWrites * slotBytes;
+    stats.savedBytes += cachedTransfers * store->recordSize() + cachedSlotReads * slotReadBytes;
+    stats.cacheBytes += topCache.size();
+    stats.roundTrips += store->roundTrips();
+    stats.wireBytes += store->wireBytes();
+    return stats;
+}
+
+// one transfer per bucket read or written back, top cache hits are the store traffic saved
+AccessStats Tree::getAccessStats() const {
+    AccessStats stats = accessStats;
+    stats.evictionChecks = stash.rangeChecks;
+    return stats;
+}
+
+void Tree::countTransfers(const size_t* nodeIDs, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (nodeIDs[i] < topCacheNodes) {
+            cachedTransfers++;
+        } else {
+            storeTransfers++;
+        }
+    }
+}
+
+// writes the node ids from pathID up to the root into out and returns how many there are
+size_t Tree::pathNodes(size_t pathID, size_t* out) const {
+    size_t count = 0;
+    while (pathID > 0) {
+        out[count++] = pathID;
+        pathID = (pathID - 1) / 2;
+    }
+    out[count++] = 0;
+    return count;
 }
 
 size_t Tree::getParent(size_t children) {
@@ -107,86 +601,210 @@ size_t Tree::getParent(size_t children) {
 }
 
 void Tree::readFromPath(size_t pathID, size_t target, bool debugMode, std::optional<double> randomReadRatio) {
-    size_t curNode = pathID;
-    while (curNode > 0) {
-        if (debugMode) {
-            std::cout << "Reading from pathID: " << curNode << std::endl;
-        }
-        for (auto& block: nodes[curNode].buckets) {
-            if (!block.isDummy) {
-                if (debugMode) {
-                    std::cout<< "Stash block: " << block.toString() << std::endl;
-                }
-                if (randomReadRatio.has_value()) {
-                    if (block.originalPosition != target) {
-                        double rDouble = randomDouble(0.0, 1.0);
-                        if (rDouble < randomReadRatio.value()) {
-                            stash.push_back(std::move(block));
-                            block = Block();
-                        } else {
-                            if (debugMode) {
-                                std::cout << "skipping instead"<< std::endl;
-                            }
-                        }
-                    } else {
-                        stash.push_back(std::move(block));
-                        block = Block();
-                    }
-                } else {
-                    stash.push_back(std::move(block));
-                }
-            }
-        }
-        if (!randomReadRatio.has_value()) {
-            nodes[curNode].clear();
-        } else {
-            nodes[curNode].deFrag();
-        }
-        curNode = getParent(curNode);
+    STATS_PHASE(accessStats, PHASE_PATH_READ);
+    size_t path[MAX_TREE_LEVEL];
+    size_t pathLength = pathNodes(pathID, path);
+    if (!ringRead(randomReadRatio)) {
+        countTransfers(path, pathLength);
+    }
+    if (staging) {
+        // the whole path is fetched and decrypted in one batch before any bucket is read
+        stageNodes(path, pathLength);
+    } else {
+        // the buckets are independent records in the store, so request all of them up front
+        store->prefetch(path, pathLength);
+    }
+    for (size_t i = 0; i < pathLength; i++) {
+        readBucket(path[i], &target, 1, debugMode, randomReadRatio);
+    }
+    if (debugMode) {
+        std::cout<<"==========================="<<std::endl;
+    }
+}
+
+void Tree::readFromPaths(const size_t* pathIDs, size_t pathCount, const size_t* targets, size_t targetCount, bool debugMode, std::optional<double> randomReadRatio) {
+    STATS_PHASE(accessStats, PHASE_PATH_READ);
+    // buckets shared by several paths are read once
+    unionNodes(pathIDs, pathCount, batchNodes);
+    if (!ringRead(randomReadRatio)) {
+        countTransfers(batchNodes.data(), batchNodes.size());
+    }
+    if (staging) {
+        stageNodes(batchNodes.data(), batchNodes.size());
+    } else {
+        store->prefetch(batchNodes.data(), batchNodes.size());
+    }
+    for (size_t nodeID : batchNodes) {
+        readBucket(nodeID, targets, targetCount, debugMode, randomReadRatio);
     }
-    for (auto& block: nodes[0].buckets) {
+    if (debugMode) {
+        std::cout<<"==========================="<<std::endl;
+    }
+}
+
+// collects every node on the given paths, deepest ids first and without duplicates
+void Tree::unionNodes(const size_t* pathIDs, size_t pathCount, std::vector<size_t>& out) const {
+    out.clear();
+    size_t path[MAX_TREE_LEVEL];
+    for (size_t i = 0; i < pathCount; i++) {
+        size_t pathLength = pathNodes(pathIDs[i], path);
+        out.insert(out.end(), path, path + pathLength);
+    }
+    std::sort(out.begin(), out.end(), std::greater<size_t>());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+}
+
+void Tree::readBucket(size_t nodeID, const size_t* targets, size_t targetCount, bool debugMode, std::optional<double> randomReadRatio) {
+    if (debugMode && nodeID > 0) {
+        std::cout << "Reading from pathID: " << nodeID << std::endl;
+    }
+    if (ringRead(randomReadRatio)) {
+        readSlots(nodeID, targets, targetCount, debugMode);
+        return;
+    }
+    Node cur = node(nodeID);
+    STATS_COUNT(accessStats, dummySlotsRead, cur.size - cur.occupied);
+    for (size_t j = 0; j < cur.occupied; j++) {
+        Block& block = cur.buckets[j];
         if (!block.isDummy) {
             if (debugMode) {
                 std::cout<< "Stash block: " << block.toString() << std::endl;
             }
             if (randomReadRatio.has_value()) {
-                if (block.originalPosition != target) {
-                    double rDouble = randomDouble(0.0, 1.0);
-                    if (rDouble < randomReadRatio.value()) {
-                        stash.push_back(std::move(block));
-                        block = Block();
+                if (std::find(targets, targets + targetCount, block.originalPosition) == targets + targetCount) {
+                    // a zero ratio (scheduled eviction) leaves every other block without drawing
+                    if (randomReadRatio.value() > 0.0 && randomDouble(0.0, 1.0) < randomReadRatio.value()) {
+                        stash.add(std::move(block), cur.payload(j));
+                        STATS_COUNT(accessStats, blocksRead, 1);
+                        block.isDummy = true;
                     } else {
                         if (debugMode) {
                             std::cout << "skipping instead"<< std::endl;
                         }
                     }
                 } else {
-                    stash.push_back(std::move(block));
-                    block = Block();
+                    stash.add(std::move(block), cur.payload(j));
+                    STATS_COUNT(accessStats, blocksRead, 1);
+                    block.isDummy = true;
                 }
             } else {
-                stash.push_back(std::move(block));
+                stash.add(std::move(block), cur.payload(j));
+                STATS_COUNT(accessStats, blocksRead, 1);
             }
         }
     }
     if (!randomReadRatio.has_value()) {
-        nodes[0].clear();
+        cur.clear();
     } else {
-        nodes[0].deFrag();
+        cur.deFrag();
     }
-    if (debugMode) {
-        std::cout<<"==========================="<<std::endl;
+}
+
+void Tree::readSlots(size_t nodeID, const size_t* targets, size_t targetCount, bool debugMode) {
+    Node cur = node(nodeID);
+    uint64_t& used = usedSlots(nodeID);
+    size_t reads = 0;
+    for (size_t j = 0; j < cur.occupied;) {
+        Block& block = cur.buckets[j];
+        if (std::find(targets, targets + targetCount, block.originalPosition) == targets + targetCount) {
+            j++;
+            continue;
+        }
+        if (debugMode) {
+            std::cout << "Stash block: " << block.toString() << " from slot " << int(cur.slots[j]) << std::endl;
+        }
+        used |= uint64_t(1) << cur.slots[j];
+        stash.add(std::move(block), cur.payload(j));
+        STATS_COUNT(accessStats, blocksRead, 1);
+        cur.remove(j);
+        reads++;
+    }
+    if (reads == 0) {
+        // reshuffles come after at most dummySlots reads, so an unread slot without a block is always left
+        size_t slotCount = bucketSize + config.dummySlots;
+        uint64_t free = slotCount == 64 ? UINT64_MAX : (uint64_t(1) << slotCount) - 1;
+        free &= ~used;
+        for (size_t j = 0; j < cur.occupied; j++) {
+            free &= ~(uint64_t(1) << cur.slots[j]);
+        }
+        if (free == 0) {
+            throw std::logic_error("ring bucket " + std::to_string(nodeID) + " has no unread dummy slot left");
+        }
+        for (size_t skip = randomSizeT(0, __builtin_popcountll(free) - 1); skip > 0; skip--) {
+            free &= free - 1;
+        }
+        used |= free & (~free + 1);
+        STATS_COUNT(accessStats, dummySlotsRead, 1);
+        reads = 1;
+    }
+    if (nodeID < topCacheNodes) {
+        cachedSlotReads += reads;
+    } else {
+        storeSlotReads += reads;
     }
 }
 
-bool Tree::isSamePath(size_t curNode, size_t leafNode) {
-    while (leafNode > curNode) {
-        leafNode = getParent(leafNode);
+void Tree::shuffleSlots(size_t nodeID) {
+    Node cur = node(nodeID);
+    uint8_t order[64];
+    size_t slotCount = bucketSize + config.dummySlots;
+    for (size_t i = 0; i < slotCount; i++) {
+        order[i] = i;
     }
-    return leafNode == curNode;
+    // partial Fisher-Yates, the blocks take the first occupied slots of a random order
+    for (size_t i = 0; i < cur.occupied; i++) {
+        std::swap(order[i], order[randomSizeT(i, slotCount - 1)]);
+        cur.slots[i] = order[i];
+    }
+    usedSlots(nodeID) = 0;
 }
 
 std::optional<int> Tree::access(Operation op, size_t position, int value, bool debugMode, std::optional<double> randomReadRatio, bool ringFlag) {
+    size_t evictPath;
+    Block* block = fetch(op, position, value, evictPath, debugMode, randomReadRatio);
+    if (block == nullptr) {
+        return std::nullopt;
+    }
+    int returnValue = 0;
+    if (op == Operation::READ) {
+        returnValue = block->value;
+    } else {
+        if (debugMode) {
+            std::cout << "Updating value from " << block->value << " to " << value << std::endl;
+        }
+        block->value = value;
+    }
+    finishAccess(evictPath, debugMode, ringFlag);
+
+    if (op == Operation::READ) {
+        return returnValue;
+    } else {
+        return std::nullopt;
+    }
+}
+
+bool Tree::accessPayload(Operation op, size_t position, const uint8_t* in, uint8_t* out, bool debugMode, std::optional<double> randomReadRatio, bool ringFlag) {
+    size_t evictPath;
+    Block* block = fetch(op, position, 0, evictPath, debugMode, randomReadRatio);
+    if (block == nullptr) {
+        return false;
+    }
+    if (payloadSize > 0) {
+        if (op == Operation::READ) {
+            std::memcpy(out, payloadOf(block), payloadSize);
+        } else {
+            std::memcpy(payloadOf(block), in, payloadSize);
+        }
+    }
+    finishAccess(evictPath, debugMode, ringFlag);
+    return true;
+}
+
+uint8_t* Tree::payloadOf(Block* block) {
+    return stash.payload(block);
+}
+
+Block* Tree::fetch(Operation op, size_t position, int value, size_t& evictPath, bool debugMode, std::optional<double> randomReadRatio) {
     if (debugMode) {
         std::cout<<"occupied: " << occupied << ", capacity: " << capacity << std::endl;
     }
@@ -194,112 +812,412 @@ std::optional<int> Tree::access(Operation op, size_t position, int value, bool d
     if (positionMap.size() <= position) {
         std::cerr << "Position out of bounds in tree positionMap." << std::endl;
         std::cerr<< "max position: " << positionMap.size() - 1 << ", looking for position: " << position << std::endl;
-        return std::nullopt;
+        return nullptr;
     }
-    if (positionMap[position].has_value()) {
-        prevPath = positionMap[position].value();
+    size_t newLeaf = randomSizeT(0, leafCount - 1);
+    std::optional<size_t> prevLeaf;
+    {
+        STATS_PHASE(accessStats, PHASE_POSITION_MAP);
+        prevLeaf = positionMap.exchange(position, newLeaf, op == Operation::WRITE && occupied < capacity);
+    }
+    if (prevLeaf.has_value()) {
+        prevPath = leafStartIndex + prevLeaf.value();
         if (debugMode) {
             std::cout<<"position found in map, prevPath: " << prevPath << std::endl;
         }
-        readFromPath(prevPath,position,debugMode, randomReadRatio);
+        readFromPath(prevPath, position, debugMode, readRatio(randomReadRatio));
     } else {
         if (op == Operation::READ) {
             std::cerr << "Position not found in positionMap for READ operation." << std::endl;
-            return std::nullopt;
+            return nullptr;
         } else if (op == Operation::WRITE && occupied >= capacity) {
             std::cerr << "Tree is full, cannot write new data." << std::endl;
-            return std::nullopt;
+            return nullptr;
         }
-        prevPath = randomSizeT(leafStartIndex, nodes.size() - 1);
+        prevPath = randomSizeT(leafStartIndex, nodeCount - 1);
         if (debugMode) {
             std::cout<<"position not found in map, generating new path: "<< prevPath << std::endl;
         }
-        readFromPath(prevPath, position, debugMode, randomReadRatio);
-        stash.push_back(Block(value, position, false));
+        readFromPath(prevPath, position, debugMode, readRatio(randomReadRatio));
+        stash.add(Block(value, position, false));
         occupied++;
     }
 
-    size_t newPath = randomSizeT(leafStartIndex, nodes.size() - 1);
     if (debugMode) {
-        std::cout<<"newPath: "<< newPath << std::endl;
-    }
-    positionMap[position] = newPath;
-    int returnValue = 0;
-    bool found = false;
-    for (auto& block : stash) {
-        if (block.originalPosition == position) {
-            found = true;
-            if (debugMode) {
-                std::cout << "Found block in stash: " << block.toString() << std::endl;
-            }
-            if (op == Operation::READ) {
-                returnValue = block.value;
-            } else {
-                block.value = value;
-                if (debugMode) {
-                    std::cout << "Updating value from " << block.value << " to " << value << std::endl;
-                }
-            }
-            break;
-        }
+        std::cout<<"newPath: "<< leafStartIndex + newLeaf << std::endl;
     }
-    if (!found) {
+    evictPath = prevPath;
+    accessCount++;
+    STATS_COUNT(accessStats, accesses, 1);
+    STATS_PHASE(accessStats, PHASE_STASH_SEARCH);
+    STATS_COUNT(accessStats, stashLookups, 1);
+    Block* block = stash.find(position);
+    if (block == nullptr) {
         std::cerr << "Block with position " << position << " not found in stash." << std::endl;
-        return std::nullopt;
+        return nullptr;
     }
-
+    if (debugMode) {
+        std::cout << "Found block in stash: " << block->toString() << std::endl;
+    }
+    stash.relabel(block, newLeaf);
     maxStashSize = std::max(maxStashSize, stash.size());
-    evict(prevPath, debugMode);
-    if (ringFlag) {
+    return block;
+}
+
+void Tree::finishAccess(size_t evictPath, bool debugMode, bool ringFlag) {
+    STATS_PHASE(accessStats, PHASE_EVICTION);
+    if (config.evictionRate > 0) {
+        size_t path[MAX_TREE_LEVEL];
+        size_t pathLength = pathNodes(evictPath, path);
+        scheduleEvictions(path, pathLength, 1, debugMode);
+    } else {
+        evict(evictPath, debugMode);
+    }
+    if (ringFlag && config.evictionRate == 0) {
         // ring oram original implementation: g = reverseBits(G), G <- G + 1
         evict(leafStartIndex + reverseBits(ringPath, treeLevel - 1), debugMode);
         ringPath = (ringPath + 1) & (leafCount - 1);
 
         // our adaptation:
         // if (prevPath < mid) {
-        //     evict(randomSizeT(mid, nodes.size() - 1), debugMode);
+        //     evict(randomSizeT(mid, nodeCount - 1), debugMode);
         // } else {
         //     evict(randomSizeT(leafStartIndex, mid - 1), debugMode);
         // }
     }
-
-    if (op == Operation::READ) {
-        return returnValue;
-    } else {
-        return std::nullopt;
+    boundStash(debugMode);
+    if (staging) {
+        flushStaged();
     }
+    STATS_STASH(accessStats, stash.size());
 }
 
 
 void Tree::evict(size_t evictPathID, bool debugMode) {
-    while (evictPathID > 0) {
-        emptyStashTo(evictPathID, debugMode);
-        evictPathID = getParent(evictPathID);
+    evictPaths(&evictPathID, 1, debugMode);
+}
+
+#define NO_BLOCK SIZE_MAX
+
+void Tree::evictPaths(const size_t* pathIDs, size_t pathCount, bool debugMode) {
+    unionNodes(pathIDs, pathCount, evictNodes);
+    fillNodes(evictNodes, debugMode);
+}
+
+void Tree::fillNodes(const std::vector<size_t>& nodeIDs, bool debugMode) {
+    countTransfers(nodeIDs.data(), nodeIDs.size());
+    if (staging) {
+        // usually already staged by the read, only ring eviction paths bring in new buckets
+        stageNodes(nodeIDs.data(), nodeIDs.size());
+    } else {
+        store->prefetch(nodeIDs.data(), nodeIDs.size());
+    }
+    // bottom-up: deeper ids come first and each node pulls blocks from its own subtree into its
+    // free slots, so whatever a node cannot take stays in the stash for its ancestors
+    size_t leafDepth = treeLevel - 1;
+    for (size_t nodeID : nodeIDs) {
+        Node target = node(nodeID);
+        if (target.occupied >= target.size) {
+            continue;
+        }
+        size_t depth = 63 - __builtin_clzll(nodeID + 1);
+        size_t firstLeaf = (nodeID - ((size_t(1) << depth) - 1)) << (leafDepth - depth);
+        size_t taken = stash.take(firstLeaf, size_t(1) << (leafDepth - depth), target.size - target.occupied, [&](Block& block, uint8_t* payload) {
+            if (debugMode) {
+                std::cout<<leafStartIndex + block.leaf<<" is on the same path as nodeID: " << nodeID << std::endl;
+                std::cout<<"putting block: " << block.toString() << " to node: " << nodeID << std::endl;
+            }
+            target.put(block, payload);
+        });
+        STATS_COUNT(accessStats, blocksWritten, taken);
+        (void)taken;
+    }
+    if (config.dummySlots > 0) {
+        // a written ring bucket gets its dummy slots back too, under a new slot order
+        for (size_t nodeID : nodeIDs) {
+            shuffleSlots(nodeID);
+            if (nodeID >= topCacheNodes) {
+                dummySlotWrites += config.dummySlots;
+            }
+        }
     }
-    emptyStashTo(0, debugMode);
     if (debugMode) {
         std::cout<<"==========================="<<std::endl;
     }
 }
 
-void Tree::emptyStashTo(size_t nodeID, bool debugMode) {
-    size_t stashSize = stash.size();
-    for (size_t i = 0; i < stashSize; i ++) {
-        if (nodes[nodeID].occupied == nodes[nodeID].size) {
+void Tree::scheduleEvictions(const size_t* nodeIDs, size_t count, size_t accesses, bool debugMode) {
+    size_t threshold = config.reshuffleReads > 0 ? config.reshuffleReads : bucketSize;
+    if (config.dummySlots > 0) {
+        // every read uses up a dummy slot at worst, the bucket has to be rewritten before they run out
+        threshold = std::min(config.reshuffleReads > 0 ? config.reshuffleReads : config.dummySlots, config.dummySlots);
+    }
+    reshuffleNodes.clear();
+    for (size_t i = 0; i < count; i++) {
+        if (++bucketReads(nodeIDs[i]) >= threshold) {
+            reshuffleNodes.push_back(nodeIDs[i]);
+        }
+    }
+    if (!reshuffleNodes.empty()) {
+        // early reshuffle: the bucket gives up all its blocks and is refilled as if it had been evicted
+        for (size_t nodeID : reshuffleNodes) {
+            readBucket(nodeID, nullptr, 0, debugMode, std::nullopt);
+            bucketReads(nodeID) = 0;
+        }
+        std::sort(reshuffleNodes.begin(), reshuffleNodes.end(), std::greater<size_t>());
+        fillNodes(reshuffleNodes, debugMode);
+        earlyReshuffles += reshuffleNodes.size();
+    }
+
+    pendingAccesses += accesses;
+    size_t due = pendingAccesses / config.evictionRate;
+    pendingAccesses %= config.evictionRate;
+    if (due == 0) {
+        return;
+    }
+    schedulePaths.clear();
+    for (size_t i = 0; i < due; i++) {
+        // g = reverseBits(G), G <- G + 1: consecutive evictions share as few buckets as possible
+        schedulePaths.push_back(leafStartIndex + reverseBits(ringPath, treeLevel - 1));
+        ringPath = (ringPath + 1) & (leafCount - 1);
+    }
+    readFromPaths(schedulePaths.data(), schedulePaths.size(), nullptr, 0, debugMode, std::nullopt);
+    for (size_t nodeID : batchNodes) {
+        bucketReads(nodeID) = 0;
+    }
+    fillNodes(batchNodes, debugMode);
+    scheduledEvictions += due;
+}
+
+size_t Tree::stashWatermark() const {
+    if (config.stashWatermark > 0) {
+        return config.stashWatermark;
+    }
+    return config.stashLimit > 0 ? config.stashLimit - config.stashLimit / 4 : SIZE_MAX;
+}
+
+void Tree::boundStash(bool debugMode) {
+    if (stash.size() <= config.stashLimit) {
+        stashOverflow = false;
+    }
+    size_t watermark = stashWatermark();
+    if (stash.size() <= watermark) {
+        return;
+    }
+    // once a sweep has failed another one would fail too, the tree only gets the watermark's single eviction
+    bool overLimit = config.stashLimit > 0 && stash.size() > config.stashLimit && !stashOverflow;
+    // a full sweep touches every bucket once, whatever is still left after that has nowhere to go
+    for (size_t round = 0; round < leafCount; round++) {
+        // dummy accesses continue the reverse lexicographic ring order, so consecutive ones spread over the tree
+        size_t path = leafStartIndex + reverseBits(ringPath, treeLevel - 1);
+        ringPath = (ringPath + 1) & (leafCount - 1);
+        readFromPaths(&path, 1, nullptr, 0, debugMode, std::nullopt);
+        for (size_t nodeID : batchNodes) {
+            bucketReads(nodeID) = 0;
+        }
+        fillNodes(batchNodes, debugMode);
+        watermarkEvictions++;
+        if (!overLimit || stash.size() <= watermark) {
+            return;
+        }
+    }
+    if (stash.size() > config.stashLimit) {
+        stashOverflow = true;
+        std::cerr << "Stash of " << stash.size() << " blocks stays above its limit of " << config.stashLimit
+                  << " after a dummy eviction of every path, the tree is too full. No more sweeps until it is back under the limit."
+                  << std::endl;
+    }
+}
+
+void Tree::bulkLoad(const size_t* positions, const int* values, size_t count, const uint8_t* payloads) {
+    if (occupied != 0) {
+        throw std::logic_error("bulk load needs an empty tree");
+    }
+    std::vector<size_t> latest(positionMap.size(), NO_BLOCK);
+    for (size_t i = 0; i < count; i++) {
+        if (positions[i] >= positionMap.size()) {
+            std::cerr << "Position out of bounds in tree positionMap." << std::endl;
+            std::cerr<< "max position: " << positionMap.size() - 1 << ", looking for position: " << positions[i] << std::endl;
+            continue;
+        }
+        latest[positions[i]] = i;
+    }
+    std::vector<size_t> loadEntries;
+    std::vector<size_t> loadPositions;
+    for (size_t i = 0; i < count; i++) {
+        if (positions[i] >= positionMap.size() || latest[positions[i]] != i) {
+            continue;
+        }
+        if (occupied >= capacity) {
+            std::cerr << "Tree is full, cannot write new data." << std::endl;
             break;
         }
-        Block curBlock = std::move(stash.front());
-        stash.pop_front();
-        if (isSamePath(nodeID, positionMap[curBlock.originalPosition].value())) {
-            if (debugMode) {
-                std::cout<<positionMap[curBlock.originalPosition].value()<<" is on the same path as nodeID: " << nodeID << std::endl;
-                std::cout<<"putting block: " << curBlock.toString() << " to node: " << nodeID << std::endl;
+        loadEntries.push_back(i);
+        loadPositions.push_back(positions[i]);
+        occupied++;
+    }
+    std::vector<size_t> loadLeaves(loadEntries.size());
+    fillRandomSizeT(loadLeaves.data(), loadLeaves.size(), 0, leafCount - 1);
+    positionMap.load(loadPositions.data(), loadLeaves.data(), loadPositions.size());
+
+    // a sealed or remote tree is filled as plaintext records first and written once, the store only holds empty
+    // buckets yet
+    std::vector<uint8_t, AlignedAllocator<uint8_t>> plains;
+    if (staging) {
+        plains.assign((nodeCount - topCacheNodes) * recordSize, 0);
+    }
+    size_t path[MAX_TREE_LEVEL];
+    for (size_t i = 0; i < loadEntries.size(); i++) {
+        Block block(values[loadEntries[i]], loadPositions[i], false);
+        block.leaf = loadLeaves[i];
+        const uint8_t* payload = payloads != nullptr ? payloads + loadEntries[i] * payloadSize : nullptr;
+        size_t pathLength = pathNodes(leafStartIndex + loadLeaves[i], path);
+        bool placed = false;
+        for (size_t j = 0; j < pathLength && !placed; j++) {
+            Node target = staging && path[j] >= topCacheNodes ? recordNode(&plains[(path[j] - topCacheNodes) * recordSize], bucketSize, payloadSize) : node(path[j]);
+            if (target.occupied < target.size) {
+                target.put(block, payload);
+                placed = true;
             }
-            nodes[nodeID].put(curBlock);
+        }
+        if (!placed) {
+            stash.add(std::move(block), payload);
+        }
+    }
+    if (staging) {
+        writeStore(plains.data(), recordSize);
+    }
+    for (size_t nodeID = 0; nodeID < nodeCount && config.dummySlots > 0; nodeID++) {
+        shuffleSlots(nodeID);
+    }
+    maxStashSize = std::max(maxStashSize, stash.size());
+    boundStash();
+    if (staging) {
+        flushStaged();
+    }
+}
+
+void Tree::reserveScratch(size_t batchSize) {
+    scratchBatch = batchSize;
+    // a batch reads its own paths, -rp or scheduled eviction add at most one eviction path per request, and the stash
+    // bound one dummy eviction
+    size_t paths = 2 * batchSize + 1;
+    size_t nodes = std::min(paths * treeLevel, nodeCount);
+    stash.reserve((config.stashLimit > 0 ? config.stashLimit : STASH_ARENA_BLOCKS) + nodes * bucketSize);
+    evictNodes.reserve(nodes);
+    batchNodes.reserve(nodes);
+    reshuffleNodes.reserve(nodes);
+    batchPaths.reserve(paths);
+    batchTargets.reserve(batchSize);
+    batchLeaves.reserve(batchSize);
+    schedulePaths.reserve(paths);
+    if (!staging) {
+        return;
+    }
+    if (stagedRecords.size() < nodes * recordSize) {
+        stagedRecords.resize(nodes * recordSize);
+    }
+    stagedNodes.reserve(nodes);
+    stagedIndex.reserve(nodes);
+    // writeStore works in chunks of MAX_TREE_LEVEL records whatever the batch
+    cipherPlains.reserve(std::max<size_t>(nodes, MAX_TREE_LEVEL));
+    cipherSealed.reserve(std::max<size_t>(nodes, MAX_TREE_LEVEL));
+    cipherNodes.reserve(std::max<size_t>(nodes, MAX_TREE_LEVEL));
+    if (cipher) {
+        cipher->reserve(std::max<size_t>(nodes, MAX_TREE_LEVEL));
+    }
+    if (cipher && !store->inPlace() && wireRecords.size() < std::max<size_t>(nodes, MAX_TREE_LEVEL) * store->recordSize()) {
+        wireRecords.resize(std::max<size_t>(nodes, MAX_TREE_LEVEL) * store->recordSize());
+    }
+}
+
+void Tree::accessBatch(AccessRequest* requests, size_t count, bool debugMode, std::optional<double> randomReadRatio, bool ringFlag) {
+    if (count > scratchBatch) {
+        reserveScratch(count);
+    }
+    // first remap every request and collect the paths to read, new blocks are created right away
+    // so a later request in the same batch sees them
+    batchPaths.clear();
+    batchTargets.clear();
+    // fresh labels for the whole batch in one draw, requests that fail are marked NO_BLOCK
+    batchLeaves.resize(count);
+    fillRandomSizeT(batchLeaves.data(), count, 0, leafCount - 1);
+    for (size_t i = 0; i < count; i++) {
+        AccessRequest& request = requests[i];
+        request.result = std::nullopt;
+        if (request.position >= positionMap.size()) {
+            std::cerr << "Position out of bounds in tree positionMap." << std::endl;
+            std::cerr<< "max position: " << positionMap.size() - 1 << ", looking for position: " << request.position << std::endl;
+            batchLeaves[i] = NO_BLOCK;
+            continue;
+        }
+        std::optional<size_t> prevLeaf;
+        {
+            STATS_PHASE(accessStats, PHASE_POSITION_MAP);
+            prevLeaf = positionMap.exchange(request.position, batchLeaves[i], request.op == Operation::WRITE && occupied < capacity);
+        }
+        if (prevLeaf.has_value()) {
+            batchPaths.push_back(leafStartIndex + prevLeaf.value());
+        } else if (request.op == Operation::READ) {
+            std::cerr << "Position not found in positionMap for READ operation." << std::endl;
+            batchLeaves[i] = NO_BLOCK;
+            continue;
+        } else if (occupied >= capacity) {
+            std::cerr << "Tree is full, cannot write new data." << std::endl;
+            batchLeaves[i] = NO_BLOCK;
+            continue;
         } else {
-            stash.push_back(std::move(curBlock));
+            batchPaths.push_back(randomSizeT(leafStartIndex, nodeCount - 1));
+            stash.add(Block(request.value, request.position, false));
+            occupied++;
         }
+        batchTargets.push_back(request.position);
     }
+
+    readFromPaths(batchPaths.data(), batchPaths.size(), batchTargets.data(), batchTargets.size(), debugMode, readRatio(randomReadRatio));
+    accessCount += batchTargets.size();
+    STATS_COUNT(accessStats, accesses, batchTargets.size());
+    maxStashSize = std::max(maxStashSize, stash.size());
+
+    // serve in request order from the stash, a repeated position ends up on the leaf it was given last
+    for (size_t i = 0; i < count; i++) {
+        if (batchLeaves[i] == NO_BLOCK) {
+            continue;
+        }
+        AccessRequest& request = requests[i];
+        STATS_PHASE(accessStats, PHASE_STASH_SEARCH);
+        STATS_COUNT(accessStats, stashLookups, 1);
+        Block* block = stash.find(request.position);
+        if (block == nullptr) {
+            std::cerr << "Block with position " << request.position << " not found in stash." << std::endl;
+            continue;
+        }
+        stash.relabel(block, batchLeaves[i]);
+        if (request.op == Operation::READ) {
+            request.result = block->value;
+        } else {
+            block->value = request.value;
+        }
+        if (ringFlag && config.evictionRate == 0) {
+            // keep the ring eviction rate of one extra path per access, written back with the rest
+            batchPaths.push_back(leafStartIndex + reverseBits(ringPath, treeLevel - 1));
+            ringPath = (ringPath + 1) & (leafCount - 1);
+        }
+    }
+    {
+        STATS_PHASE(accessStats, PHASE_EVICTION);
+        if (config.evictionRate > 0) {
+            // batchNodes still holds the union read above, it is only reused once the reads are counted
+            scheduleEvictions(batchNodes.data(), batchNodes.size(), batchTargets.size(), debugMode);
+        } else {
+            evictPaths(batchPaths.data(), batchPaths.size(), debugMode);
+        }
+        boundStash(debugMode);
+        if (staging) {
+            flushStaged();
+        }
+    }
+    STATS_STASH(accessStats, stash.size());
 }
 
 
@@ -307,18 +1225,46 @@ std::string Tree::toString() const {
     std::string result = "Tree(levels:" + std::to_string(treeLevel) + 
                         ", leafStart:" + std::to_string(leafStartIndex) + ")\n";
     result += "stash size: " + std::to_string(stash.size()) + "\n";
-    result += "rp enabled info only:\n";
+    if (config.evictionRate > 0) {
+        result += "scheduled eviction every " + std::to_string(config.evictionRate) + " accesses, " +
+                  std::to_string(scheduledEvictions) + " evictions and " + std::to_string(earlyReshuffles) + " early reshuffles so far\n";
+    }
+    if (config.dummySlots > 0) {
+        result += "ring buckets of " + std::to_string(bucketSize) + " + " + std::to_string(config.dummySlots) + " dummy slots, " +
+                  std::to_string(storeSlotReads + cachedSlotReads) + " single slot reads so far\n";
+    }
+    if (stashWatermark() != SIZE_MAX) {
+        result += "stash watermark " + std::to_string(stashWatermark()) + ", limit " + std::to_string(config.stashLimit) + ", " +
+                  std::to_string(watermarkEvictions) + " dummy evictions so far" +
+                  (stashOverflow ? ", above the limit after a full sweep" : "") + "\n";
+    }
+    result += "rp and scheduled eviction info only:\n";
     result += "next ring Path: " + std::to_string(reverseBits(ringPath, treeLevel - 1)) + "\n";
     result += "next actual evict path: " + std::to_string(leafStartIndex + reverseBits(ringPath, treeLevel - 1)) + "\n";
     result += "===========================\n";
     result += "Nodes:\n";
-    for (size_t i = 0; i < nodes.size(); i++) {
-        result += "  " + std::to_string(i) + ": " + nodes[i].toString() + "\n";
+    if (cipher) {
+        // opening buckets here would consume fresh nonces and count as accesses, so only the summary is printed
+        result += "  " + std::to_string(nodeCount) + " buckets sealed with " + cipherKindName(cipher->getKind()) + "\n";
+    } else if (staging) {
+        // fetching them would be store traffic of its own
+        result += "  " + std::to_string(nodeCount) + " buckets on " + store->describe() + "\n";
+    }
+    for (size_t i = 0; i < nodeCount && !staging; i++) {
+        const uint8_t* record = i < topCacheNodes ? &topCache[i * recordSize] : store->record(i);
+        result += "  " + std::to_string(i) + ": " + bucketToString(reinterpret_cast<const Block*>(record + BUCKET_HEADER_SIZE),
+                                                                   *reinterpret_cast<const uint32_t*>(record), bucketSize) + "\n";
     }
 
     result += "Position Map:\n";
-    for (size_t i = 0; i < positionMap.size(); i++) {
-        result += "  Pos " + std::to_string(i) + " -> Path " + std::to_string(positionMap[i].value_or(0)) + "\n";
+    if (positionMap.isRecursive()) {
+        // reading a recursive map entry is an ORAM access of its own, so only the summary is printed
+        result += positionMap.getStats();
+    } else {
+        for (size_t i = 0; i < positionMap.size(); i++) {
+            std::optional<size_t> leaf = positionMap.peek(i);
+            result += "  Pos " + std::to_string(i) + " -> Path " + std::to_string(leaf.has_value() ? leafStartIndex + leaf.value() : 0) + "\n";
+        }
     }
 
     result += "Stash (" + std::to_string(stash.size()) + " blocks):\n";
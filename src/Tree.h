@@ -11,43 +11,177 @@
 #include <climits>
 #include <iostream>
 #include <list>
+#include <cstdint>
+#include <memory>
+
+#include "AccessStats.h"
+#include "AlignedAllocator.h"
+#include "BucketStore.h"
+#include "FlatIndex.h"
+#include "PositionMap.h"
+#include "Snapshot.h"
+#include "TreeConfig.h"
 
 #define MAX_TREE_SIZE 65535
+// deepest tree we ever build, used to size the per-path scratch arrays
+#define MAX_TREE_LEVEL 64
+// stash blocks preallocated between accesses when the stash has no limit, comfortably above what plain path reads
+// leave behind. A stash limit replaces it
+#define STASH_ARENA_BLOCKS 128
 
 enum Operation {
     READ,
     WRITE
 };
 
+// one access of a batch, result is filled in by a READ
+struct AccessRequest {
+    Operation op;
+    size_t position;
+    int value;
+    std::optional<int> result;
+};
 
+// 16 bytes, so a default bucket holds its 4 blocks in 64 bytes. With the BUCKET_HEADER_SIZE header in front a record
+// takes two cache lines, and the memory store starts every record on a line boundary.
+// leaf is the block's label relative to leafStartIndex, carried along so eviction never consults the position map
 struct Block {
-    int value;
     size_t originalPosition;
-    bool isDummy;
+    int value;
+    uint32_t leaf : 31;
+    uint32_t isDummy : 1;
     Block();
     Block(int value, size_t originalPosition, bool isDummy = false);
     std::string toString() const;
 };
 
+// non-owning view over one bucket record: a BUCKET_HEADER_SIZE header holding occupied, then the blocks, then
+// one payloadSize slot per block in the same order. Ring buckets end with the physical slot of each block
 class Node {
 public:
-    std::vector<Block> buckets;
-    size_t occupied;
+    Block* buckets;
+    uint32_t& occupied;
     size_t size;
+    uint8_t* payloads;
+    size_t payloadSize;
+    // nullptr unless the tree uses ring buckets, moves along with the blocks
+    uint8_t* slots;
 
-    Node(size_t bucketSize = 4);
+    Node(Block* buckets, uint32_t& occupied, size_t size, uint8_t* payloads = nullptr, size_t payloadSize = 0, uint8_t* slots = nullptr);
+    uint8_t* payload(size_t index) const {
+        return payloads + index * payloadSize;
+    }
     void clear();
     void deFrag();
-    void put(Block& block);
+    // copies payload along with the block, nullptr stores a zeroed payload
+    void put(Block& block, const uint8_t* payload = nullptr);
     void remove(size_t index);
     std::string toString() const;
 };
 
+// client stash. Blocks sit densely in one vector, an index keyed by originalPosition finds a block in O(1)
+// and every block is also linked into the bucket of the top prefixBits bits of its leaf, with a bitmap of the
+// non-empty buckets. Eviction pulls blocks for one subtree at a time, so its cost follows the free slots on the
+// path rather than the stash occupancy
+class Stash {
+public:
+    static constexpr size_t NO_SLOT = SIZE_MAX;
+    // blocks take tested against a leaf range, only counted with ORAM_STATS
+    uint64_t rangeChecks = 0;
+
+    explicit Stash(size_t leafDepth = 0, size_t payloadSize = 0);
+    size_t size() const {
+        return blocks.size();
+    }
+    bool empty() const {
+        return blocks.empty();
+    }
+    std::vector<Block>::const_iterator begin() const {
+        return blocks.begin();
+    }
+    std::vector<Block>::const_iterator end() const {
+        return blocks.end();
+    }
+    // nullptr when the block is not in the stash. Pointers stay valid until the next add or take
+    Block* find(size_t position);
+    // payloads sit in their own arena, slot for slot with the blocks
+    uint8_t* payload(const Block* block) {
+        return payloads.data() + (block - blocks.data()) * payloadSize;
+    }
+    const uint8_t* payload(const Block* block) const {
+        return payloads.data() + (block - blocks.data()) * payloadSize;
+    }
+    // copies payload in, nullptr adds a zeroed payload
+    Block& add(Block&& block, const uint8_t* payload = nullptr);
+    // room for capacity blocks, adding up to that many never allocates
+    void reserve(size_t capacity);
+    void relabel(Block* block, size_t leaf);
+    // hands at most limit blocks with a leaf in [firstLeaf, firstLeaf + leafSpan) and their payloads to
+    // consume(Block&, uint8_t*), which must move them out, and drops them from the stash. Returns how many were taken
+    template <typename Consume>
+    size_t take(size_t firstLeaf, size_t leafSpan, size_t limit, Consume&& consume);
+
+private:
+    size_t leafShift;
+    size_t payloadSize;
+    FlatIndex index;
+    std::vector<Block> blocks;
+    std::vector<uint8_t> payloads;
+    // intrusive bucket lists over the slots of blocks
+    std::vector<size_t> bucketHead;
+    std::vector<size_t> bucketNext;
+    std::vector<size_t> bucketPrev;
+    std::vector<uint64_t> nonEmpty;
+
+    void link(size_t slot);
+    void unlink(size_t slot);
+    void removeSlot(size_t slot);
+};
+
+template <typename Consume>
+size_t Stash::take(size_t firstLeaf, size_t leafSpan, size_t limit, Consume&& consume) {
+    size_t taken = 0;
+    size_t lastLeaf = firstLeaf + leafSpan - 1;
+    size_t firstBucket = firstLeaf >> leafShift;
+    size_t lastBucket = lastLeaf >> leafShift;
+    for (size_t word = firstBucket / 64; word <= lastBucket / 64 && taken < limit; word++) {
+        uint64_t bits = nonEmpty[word];
+        while (bits != 0 && taken < limit) {
+            size_t bucket = word * 64 + __builtin_ctzll(bits);
+            bits &= bits - 1;
+            if (bucket < firstBucket || bucket > lastBucket) {
+                continue;
+            }
+            size_t slot = bucketHead[bucket];
+            while (slot != NO_SLOT && taken < limit) {
+                size_t next = bucketNext[slot];
+                size_t leaf = blocks[slot].leaf;
+                STATS_COUNT(*this, rangeChecks, 1);
+                if (leaf >= firstLeaf && leaf <= lastLeaf) {
+                    consume(blocks[slot], payloads.data() + slot * payloadSize);
+                    // the last block moves into the freed slot, follow it if it was the next one in this list
+                    size_t last = blocks.size() - 1;
+                    removeSlot(slot);
+                    if (next == last) {
+                        next = slot;
+                    }
+                    taken++;
+                }
+                slot = next;
+            }
+        }
+    }
+    return taken;
+}
+
 class Tree {
 public:
-    std::vector<Node> nodes;
-    std::vector<std::optional<size_t>> positionMap;
-    std::deque<Block> stash;
+    // one fixed-width record per bucket, in memory or in a mapped file
+    std::unique_ptr<BucketStore> store;
+    PositionMap positionMap;
+    Stash stash;
+    size_t nodeCount;
+    size_t bucketSize;
     size_t leafStartIndex;
     size_t treeLevel;
     size_t capacity;
@@ -56,15 +190,130 @@ public:
     size_t ringPath;
     size_t mid;
     size_t maxStashSize = 0;
-    Tree(size_t nodeCount, size_t bucketSize = 4, std::optional<int> preDesignedCap = std::nullopt);
+    // scheduled eviction: accesses since the last scheduled eviction, and what the schedule has done so far
+    size_t pendingAccesses = 0;
+    uint64_t scheduledEvictions = 0;
+    uint64_t earlyReshuffles = 0;
+    // dummy path evictions spent keeping the stash under its watermark
+    uint64_t watermarkEvictions = 0;
+    // set when a sweep of every path left the stash above stashLimit, so the next accesses do not sweep again
+    bool stashOverflow = false;
+    // eviction and batch scratch, kept between calls so the hot path does not reallocate
+    std::vector<size_t> evictNodes;
+    std::vector<size_t> batchNodes;
+    std::vector<size_t> batchPaths;
+    std::vector<size_t> batchTargets;
+    std::vector<size_t> batchLeaves;
+    std::vector<size_t> schedulePaths;
+    std::vector<size_t> reshuffleNodes;
+    // the stash and the scratch above are reserved for batches of this many requests
+    size_t scratchBatch = 0;
+    TreeConfig config;
+    size_t payloadSize;
+    // plaintext record size, header + blocks + payloads. Without a cipher the store holds these records and buckets are
+    // viewed in place, with one every store record is sealed and the buckets of the paths in flight are
+    // staged as plaintext records until the write-back seals them again
+    size_t recordSize;
+    std::unique_ptr<BucketCipher> cipher;
+    // sealed or remote: buckets are staged on the client for the paths in flight instead of being viewed in place
+    bool staging = false;
+    // node ids below topCacheNodes are the cached top levels, held as plaintext records in topCache
+    size_t topCacheNodes = 0;
+    std::vector<uint8_t, AlignedAllocator<uint8_t>> topCache;
+    uint64_t accessCount = 0;
+    uint64_t storeTransfers = 0;
+    uint64_t cachedTransfers = 0;
+    // ring buckets: single slots read by accesses, and the dummy slots written along with every store bucket
+    uint64_t storeSlotReads = 0;
+    uint64_t cachedSlotReads = 0;
+    uint64_t dummySlotWrites = 0;
+    // filled only when built with ORAM_STATS
+    AccessStats accessStats;
+    std::vector<uint8_t, AlignedAllocator<uint8_t>> stagedRecords;
+    std::vector<size_t> stagedNodes;
+    FlatIndex stagedIndex;
+    std::vector<uint8_t*> cipherPlains;
+    std::vector<uint8_t*> cipherSealed;
+    std::vector<size_t> cipherNodes;
+    // sealed records on their way to or from a remote store
+    std::vector<uint8_t, AlignedAllocator<uint8_t>> wireRecords;
+    Tree(size_t nodeCount, size_t bucketSize = 4, std::optional<int> preDesignedCap = std::nullopt, const TreeConfig& config = TreeConfig());
+    // a tree written by save, its store records are used in place from the snapshot mapping
+    explicit Tree(SnapshotReader& reader);
     size_t getRange() const;
     size_t getParent(size_t children);
+    Node node(size_t nodeID);
+    // the plaintext record behind node(nodeID)
+    uint8_t* record(size_t nodeID);
+    // false when the occupancy, a block's leaf or position or a ring slot of record is out of range
+    bool validRecord(uint8_t* record) const;
+    // staging only: throws runtime_error unless every record staged from index first on is valid
+    void checkStaged(size_t first);
+    uint32_t& bucketReads(size_t nodeID);
+    uint64_t& usedSlots(size_t nodeID);
+    size_t pathNodes(size_t pathID, size_t* out) const;
+    // ring buckets read one slot per bucket online, eviction and reshuffles still move whole buckets
+    bool ringRead(std::optional<double> randomReadRatio) const {
+        return config.dummySlots > 0 && randomReadRatio.has_value();
+    }
     void readFromPath(size_t pathID,size_t target,bool debugMode = false, std::optional<double> randomReadRatio = std::nullopt);
-    bool isSamePath(size_t curNode, size_t leafNode);
+    void readFromPaths(const size_t* pathIDs, size_t pathCount, const size_t* targets, size_t targetCount, bool debugMode = false, std::optional<double> randomReadRatio = std::nullopt);
+    void readBucket(size_t nodeID, const size_t* targets, size_t targetCount, bool debugMode, std::optional<double> randomReadRatio);
+    // ring buckets, online read: takes the targets out of their slots, or one random unread dummy slot when the bucket
+    // holds none of them. Either way the bucket only gives up the slots that were read
+    void readSlots(size_t nodeID, const size_t* targets, size_t targetCount, bool debugMode);
+    // ring buckets, after a write: fresh random slots for the blocks and every slot unread again
+    void shuffleSlots(size_t nodeID);
+    // ratio an access reads its path with, scheduled eviction leaves everything but the targets in place
+    std::optional<double> readRatio(std::optional<double> randomReadRatio) const {
+        return config.evictionRate > 0 ? std::optional<double>(randomReadRatio.value_or(0.0)) : randomReadRatio;
+    }
+    void unionNodes(const size_t* pathIDs, size_t pathCount, std::vector<size_t>& out) const;
     std::optional<int> access(Operation op, size_t position, int value = 0, bool debugMode = false, std::optional<double> randomReadRatio = std::nullopt, bool ringFlag = false);
+    // access to the payload of position: READ copies it to out, WRITE copies in over it (a new block gets value 0).
+    // false when a READ finds nothing or the access fails
+    bool accessPayload(Operation op, size_t position, const uint8_t* in, uint8_t* out, bool debugMode = false, std::optional<double> randomReadRatio = std::nullopt, bool ringFlag = false);
+    // first half of an access: remaps position, reads its path and returns the block inside the stash
+    // (created with value for a new WRITE), or nullptr. The pointer is valid until finishAccess.
+    Block* fetch(Operation op, size_t position, int value, size_t& evictPath, bool debugMode = false, std::optional<double> randomReadRatio = std::nullopt);
+    // payload bytes of a block returned by fetch, payloadSize of them
+    uint8_t* payloadOf(Block* block);
+    void finishAccess(size_t evictPath, bool debugMode = false, bool ringFlag = false);
     std::string toString() const;
     void evict(size_t evictPathID, bool debugMode = false);
-    void emptyStashTo(size_t nodeID, bool debugMode = false);
+    // one combined write-back over the union of the paths, each shared bucket is filled once
+    void evictPaths(const size_t* pathIDs, size_t pathCount, bool debugMode = false);
+    // fills the given nodes from the stash, deepest ids first
+    void fillNodes(const std::vector<size_t>& nodeIDs, bool debugMode = false);
+    // scheduled mode, after the reads of accesses requests: counts a read on each of the given buckets, reshuffles the
+    // ones that reached the threshold and runs every eviction that fell due. Due paths are read and refilled together
+    void scheduleEvictions(const size_t* nodeIDs, size_t count, size_t accesses, bool debugMode = false);
+    // after an access: one dummy path eviction in ring order when the stash is above the watermark, as many as it
+    // takes to get back under the watermark when it is above the limit, unless an earlier sweep already failed
+    void boundStash(bool debugMode = false);
+    // SIZE_MAX when the stash is unbounded
+    size_t stashWatermark() const;
+    // serves count requests with one read of the union of their paths and one write-back, results land in requests
+    void accessBatch(AccessRequest* requests, size_t count, bool debugMode = false, std::optional<double> randomReadRatio = std::nullopt, bool ringFlag = false);
+    // initial load of an empty tree without any ORAM access: every block gets a random leaf and goes straight
+    // into the deepest bucket of its path with room, or the stash. A repeated position keeps its last value.
+    // payloads, when given, holds payloadSize bytes per entry, otherwise the payloads start zeroed
+    void bulkLoad(const size_t* positions, const int* values, size_t count, const uint8_t* payloads = nullptr);
+    // preallocates the stash and every per access scratch buffer for batches of batchSize requests, so accesses of
+    // that size stay off the heap. Only a stash without a limit can still outgrow its arena
+    void reserveScratch(size_t batchSize);
+    // staging only: fetches and decrypts the given buckets that are not staged yet in one batch
+    void stageNodes(const size_t* nodeIDs, size_t count);
+    // staging only: seals every staged bucket with fresh nonces and sends it back in one batch, then drops the
+    // plaintext copies
+    void flushStaged();
+    void writeStore(const uint8_t* plains, size_t plainStride);
+    // geometry, ring counter, cipher key, top cache, stash, store records and position map, between accesses only
+    void save(SnapshotWriter& writer) const;
+    CryptoStats getCryptoStats() const;
+    BucketTransferStats getTransferStats() const;
+    AccessStats getAccessStats() const;
+    void countTransfers(const size_t* nodeIDs, size_t count);
 };
 
 #endif // TREE_H
\ No newline at end of file
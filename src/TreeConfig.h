@@ -0,0 +1,45 @@
+#ifndef TREE_CONFIG_H
+#define TREE_CONFIG_H
+
+#include <optional>
+#include <string>
+#include <cstddef>
+
+#include "BucketCipher.h"
+
+// options a Tree is built with, the map trees of a recursive position map inherit them unchanged
+struct TreeConfig {
+    // switch to a recursive position map once the flat one would take more client bytes than this
+    std::optional<size_t> posMapBudget;
+    // seal every bucket at rest, only the buckets of the paths in flight are held in plaintext
+    CipherKind cipher = CipherKind::NONE;
+    // bucket file of a file backed store, empty keeps the buckets in memory
+    std::string storePath;
+    // UNIX socket of an oram_server holding the buckets instead, storePath is then ignored
+    std::string serverSocket;
+    // the top k levels stay in client memory as plaintext and never go through the store or the cipher
+    size_t topCacheLevels = 0;
+    // opaque bytes every block carries beside its int value, e.g. 4096 for page sized records. They live in their
+    // own area of the bucket record and of the stash, so eviction decisions only read the 16 byte block metadata
+    size_t payloadSize = 0;
+    // scheduled eviction: 0 writes every read path back after its access. A > 0 reads only the target block out of
+    // each bucket and evicts one path every A accesses, in reverse lexicographic order
+    size_t evictionRate = 0;
+    // scheduled eviction only: a bucket read this many times since it was last written is reshuffled early,
+    // 0 uses the bucket size
+    size_t reshuffleReads = 0;
+    // ring buckets, scheduled eviction only: every bucket also has this many dummy slots and a permutation of its
+    // slots, so an access reads exactly one slot per bucket instead of the whole bucket. Reshuffles come after at
+    // most this many reads. 0 keeps plain buckets
+    size_t dummySlots = 0;
+    // bound on the stash between accesses, 0 leaves it unbounded. Once an access leaves more blocks than this,
+    // dummy path evictions run until the stash is back under the watermark, at most one sweep over every path. A tree
+    // still above the limit after that is too full: it warns once and only gets one dummy eviction per access, with
+    // no further sweeps, until the stash drops back under the limit
+    size_t stashLimit = 0;
+    // above this the tree pays the stash down with one dummy path eviction per access, 0 uses three quarters of
+    // stashLimit (or nothing when that is 0 too)
+    size_t stashWatermark = 0;
+};
+
+#endif // TREE_CONFIG_H
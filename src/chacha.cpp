@@ -0,0 +1,321 @@
+#include "chacha.h"
+
+static inline uint32_t rotl32(uint32_t value, int shift) {
+    return (value << shift) | (value >> (32 - shift));
+}
+
+static inline void quarterRound(uint32_t* x, int a, int b, int c, int d) {
+    x[a] += x[b]; x[d] = rotl32(x[d] ^ x[a], 16);
+    x[c] += x[d]; x[b] = rotl32(x[b] ^ x[c], 12);
+    x[a] += x[b]; x[d] = rotl32(x[d] ^ x[a], 8);
+    x[c] += x[d]; x[b] = rotl32(x[b] ^ x[c], 7);
+}
+
+void chacha20Block(const uint32_t key[CHACHA_KEY_WORDS], uint32_t counter, const uint32_t nonce[CHACHA_NONCE_WORDS], uint32_t out[CHACHA_BLOCK_WORDS]) {
+    // "expand 32-byte k"
+    uint32_t state[CHACHA_BLOCK_WORDS] = {
+        0x61707865, 0x3320646e, 0x79622d32, 0x6b206574,
+        key[0], key[1], key[2], key[3], key[4], key[5], key[6], key[7],
+        counter, nonce[0], nonce[1], nonce[2]
+    };
+    for (int i = 0; i < CHACHA_BLOCK_WORDS; i++) {
+        out[i] = state[i];
+    }
+    for (int round = 0; round < 10; round++) {
+        quarterRound(out, 0, 4, 8, 12);
+        quarterRound(out, 1, 5, 9, 13);
+        quarterRound(out, 2, 6, 10, 14);
+        quarterRound(out, 3, 7, 11, 15);
+        quarterRound(out, 0, 5, 10, 15);
+        quarterRound(out, 1, 6, 11, 12);
+        quarterRound(out, 2, 7, 8, 13);
+        quarterRound(out, 3, 4, 9, 14);
+    }
+    for (int i = 0; i < CHACHA_BLOCK_WORDS; i++) {
+        out[i] += state[i];
+    }
+}
+
+static inline uint64_t load64(const uint8_t* bytes) {
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--) {
+        value = (value << 8) | bytes[i];
+    }
+    return value;
+}
+
+static inline void store64(uint8_t* bytes, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        bytes[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+static inline uint32_t load32(const uint8_t* bytes) {
+    return uint32_t(bytes[0]) | (uint32_t(bytes[1]) << 8) | (uint32_t(bytes[2]) << 16) | (uint32_t(bytes[3]) << 24);
+}
+
+static const uint32_t CHACHA_SIGMA[4] = {0x61707865, 0x3320646e, 0x79622d32, 0x6b206574};
+
+// the scalar rounds above, with every state word widened to a vector holding one block per lane
+#define CHACHA_VECTOR_QR(x, a, b, c, d)                                         \
+    x[a] += x[b]; x[d] ^= x[a]; x[d] = (x[d] << 16) | (x[d] >> 16);             \
+    x[c] += x[d]; x[b] ^= x[c]; x[b] = (x[b] << 12) | (x[b] >> 20);             \
+    x[a] += x[b]; x[d] ^= x[a]; x[d] = (x[d] << 8) | (x[d] >> 24);              \
+    x[c] += x[d]; x[b] ^= x[c]; x[b] = (x[b] << 7) | (x[b] >> 25);
+
+#define CHACHA_LANES_BODY(V, LANES)                                             \
+    {                                                                           \
+        V state[CHACHA_BLOCK_WORDS];                                            \
+        V x[CHACHA_BLOCK_WORDS];                                                \
+        for (int i = 0; i < 4; i++) {                                           \
+            state[i] = V{} + CHACHA_SIGMA[i];                                   \
+        }                                                                       \
+        for (int i = 0; i < CHACHA_KEY_WORDS; i++) {                            \
+            state[4 + i] = V{} + key[i];                                        \
+        }                                                                       \
+        for (int lane = 0; lane < LANES; lane++) {                              \
+            state[12][lane] = counters[lane];                                   \
+            state[13][lane] = nonces[3 * lane];                                 \
+            state[14][lane] = nonces[3 * lane + 1];                             \
+            state[15][lane] = nonces[3 * lane + 2];                             \
+        }                                                                       \
+        for (int i = 0; i < CHACHA_BLOCK_WORDS; i++) {                          \
+            x[i] = state[i];                                                    \
+        }                                                                       \
+        for (int round = 0; round < 10; round++) {                              \
+            CHACHA_VECTOR_QR(x, 0, 4, 8, 12)                                    \
+            CHACHA_VECTOR_QR(x, 1, 5, 9, 13)                                    \
+            CHACHA_VECTOR_QR(x, 2, 6, 10, 14)                                   \
+            CHACHA_VECTOR_QR(x, 3, 7, 11, 15)                                   \
+            CHACHA_VECTOR_QR(x, 0, 5, 10, 15)                                   \
+            CHACHA_VECTOR_QR(x, 1, 6, 11, 12)                                   \
+            CHACHA_VECTOR_QR(x, 2, 7, 8, 13)                                    \
+            CHACHA_VECTOR_QR(x, 3, 4, 9, 14)                                    \
+        }                                                                       \
+        for (int i = 0; i < CHACHA_BLOCK_WORDS; i++) {                          \
+            x[i] += state[i];                                                   \
+        }                                                                       \
+        for (int lane = 0; lane < LANES; lane++) {                              \
+            for (int i = 0; i < CHACHA_BLOCK_WORDS; i++) {                      \
+                out[lane * CHACHA_BLOCK_WORDS + i] = x[i][lane];                \
+            }                                                                   \
+        }                                                                       \
+    }
+
+typedef uint32_t ChachaVec4 __attribute__((vector_size(16)));
+
+// four blocks per call, baseline SSE2 on x86-64 and NEON or plain code elsewhere
+static void chachaLanes4(const uint32_t* key, const uint32_t* counters, const uint32_t* nonces, uint32_t* out)
+    CHACHA_LANES_BODY(ChachaVec4, 4)
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CHACHA_HAS_AVX2_PATH 1
+typedef uint32_t ChachaVec8 __attribute__((vector_size(32)));
+
+// eight blocks per call in ymm registers, only entered after the cpu check below
+__attribute__((target("avx2")))
+static void chachaLanes8(const uint32_t* key, const uint32_t* counters, const uint32_t* nonces, uint32_t* out)
+    CHACHA_LANES_BODY(ChachaVec8, 8)
+
+static bool hasAvx2() {
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+#endif
+
+void chacha20Blocks(const uint32_t key[CHACHA_KEY_WORDS], const uint32_t* counters, const uint32_t* nonces, uint32_t* out, size_t count) {
+    size_t i = 0;
+#ifdef CHACHA_HAS_AVX2_PATH
+    if (hasAvx2()) {
+        for (; i + 8 <= count; i += 8) {
+            chachaLanes8(key, counters + i, nonces + 3 * i, out + CHACHA_BLOCK_WORDS * i);
+        }
+    }
+#endif
+    for (; i + 4 <= count; i += 4) {
+        chachaLanes4(key, counters + i, nonces + 3 * i, out + CHACHA_BLOCK_WORDS * i);
+    }
+    for (; i < count; i++) {
+        chacha20Block(key, counters[i], nonces + 3 * i, out + CHACHA_BLOCK_WORDS * i);
+    }
+}
+
+// 44 + 44 + 42 bit limbs so every product fits an unsigned __int128 (poly1305-donna-64 layout)
+#define POLY_MASK44 0xfffffffffffULL
+#define POLY_MASK42 0x3ffffffffffULL
+
+Poly1305::Poly1305(const uint8_t key[POLY1305_KEY_BYTES]) : buffered(0) {
+    uint64_t t0 = load64(key);
+    uint64_t t1 = load64(key + 8);
+    // clamped r as required by the spec
+    r[0] = t0 & 0xffc0fffffffULL;
+    r[1] = ((t0 >> 44) | (t1 << 20)) & 0xfffffc0ffffULL;
+    r[2] = (t1 >> 24) & 0x00ffffffc0fULL;
+    h[0] = h[1] = h[2] = 0;
+    pad[0] = load64(key + 16);
+    pad[1] = load64(key + 24);
+}
+
+void Poly1305::blocks(const uint8_t* data, size_t length, uint64_t hibit) {
+    typedef unsigned __int128 u128;
+    uint64_t r0 = r[0], r1 = r[1], r2 = r[2];
+    uint64_t s1 = r1 * (5 << 2), s2 = r2 * (5 << 2);
+    uint64_t h0 = h[0], h1 = h[1], h2 = h[2];
+    while (length >= 16) {
+        uint64_t t0 = load64(data);
+        uint64_t t1 = load64(data + 8);
+        h0 += t0 & POLY_MASK44;
+        h1 += ((t0 >> 44) | (t1 << 20)) & POLY_MASK44;
+        h2 += ((t1 >> 24) & POLY_MASK42) | hibit;
+
+        u128 d0 = (u128)h0 * r0 + (u128)h1 * s2 + (u128)h2 * s1;
+        u128 d1 = (u128)h0 * r1 + (u128)h1 * r0 + (u128)h2 * s2;
+        u128 d2 = (u128)h0 * r2 + (u128)h1 * r1 + (u128)h2 * r0;
+
+        uint64_t c = (uint64_t)(d0 >> 44); h0 = (uint64_t)d0 & POLY_MASK44;
+        d1 += c; c = (uint64_t)(d1 >> 44); h1 = (uint64_t)d1 & POLY_MASK44;
+        d2 += c; c = (uint64_t)(d2 >> 42); h2 = (uint64_t)d2 & POLY_MASK42;
+        h0 += c * 5; c = h0 >> 44; h0 &= POLY_MASK44;
+        h1 += c;
+
+        data += 16;
+        length -= 16;
+    }
+    h[0] = h0;
+    h[1] = h1;
+    h[2] = h2;
+}
+
+void Poly1305::update(const uint8_t* data, size_t length) {
+    if (buffered > 0) {
+        while (buffered < 16 && length > 0) {
+            buffer[buffered++] = *data++;
+            length--;
+        }
+        if (buffered < 16) {
+            return;
+        }
+        blocks(buffer, 16, 1ULL << 40);
+        buffered = 0;
+    }
+    size_t whole = length & ~size_t(15);
+    blocks(data, whole, 1ULL << 40);
+    for (size_t i = whole; i < length; i++) {
+        buffer[buffered++] = data[i];
+    }
+}
+
+void Poly1305::finish(uint8_t tag[POLY1305_TAG_BYTES]) {
+    if (buffered > 0) {
+        // a short final block gets its 1 bit appended in place instead of at bit 128
+        buffer[buffered] = 1;
+        for (size_t i = buffered + 1; i < 16; i++) {
+            buffer[i] = 0;
+        }
+        blocks(buffer, 16, 0);
+        buffered = 0;
+    }
+    uint64_t h0 = h[0], h1 = h[1], h2 = h[2];
+    uint64_t c = h1 >> 44; h1 &= POLY_MASK44;
+    h2 += c; c = h2 >> 42; h2 &= POLY_MASK42;
+    h0 += c * 5; c = h0 >> 44; h0 &= POLY_MASK44;
+    h1 += c; c = h1 >> 44; h1 &= POLY_MASK44;
+    h2 += c; c = h2 >> 42; h2 &= POLY_MASK42;
+    h0 += c * 5; c = h0 >> 44; h0 &= POLY_MASK44;
+    h1 += c;
+
+    // h - p, selected without branches when h >= p
+    uint64_t g0 = h0 + 5; c = g0 >> 44; g0 &= POLY_MASK44;
+    uint64_t g1 = h1 + c; c = g1 >> 44; g1 &= POLY_MASK44;
+    uint64_t g2 = h2 + c - (1ULL << 42);
+    c = (g2 >> 63) - 1;
+    g0 &= c; g1 &= c; g2 &= c;
+    c = ~c;
+    h0 = (h0 & c) | g0;
+    h1 = (h1 & c) | g1;
+    h2 = (h2 & c) | g2;
+
+    uint64_t t0 = pad[0], t1 = pad[1];
+    h0 += t0 & POLY_MASK44; c = h0 >> 44; h0 &= POLY_MASK44;
+    h1 += (((t0 >> 44) | (t1 << 20)) & POLY_MASK44) + c; c = h1 >> 44; h1 &= POLY_MASK44;
+    h2 += ((t1 >> 24) & POLY_MASK42) + c; h2 &= POLY_MASK42;
+
+    store64(tag, h0 | (h1 << 44));
+    store64(tag + 8, (h1 >> 20) | (h2 << 24));
+}
+
+void chacha20Poly1305Tag(const uint8_t polyKey[POLY1305_KEY_BYTES], const uint8_t* aad, size_t aadLength,
+                         const uint8_t* cipher, size_t length, uint8_t tag[POLY1305_TAG_BYTES]) {
+    static const uint8_t zeros[16] = {0};
+    Poly1305 mac(polyKey);
+    mac.update(aad, aadLength);
+    if (aadLength % 16 != 0) {
+        mac.update(zeros, 16 - aadLength % 16);
+    }
+    mac.update(cipher, length);
+    if (length % 16 != 0) {
+        mac.update(zeros, 16 - length % 16);
+    }
+    uint8_t lengths[16];
+    store64(lengths, aadLength);
+    store64(lengths + 8, length);
+    mac.update(lengths, 16);
+    mac.finish(tag);
+}
+
+// keystream block counter 0 becomes the one-time Poly1305 key, the message starts at counter 1
+static void chacha20Poly1305Setup(const uint8_t key[32], const uint8_t nonce[12], uint32_t keyWords[CHACHA_KEY_WORDS],
+                                  uint32_t nonceWords[CHACHA_NONCE_WORDS], uint8_t polyKey[POLY1305_KEY_BYTES]) {
+    for (int i = 0; i < CHACHA_KEY_WORDS; i++) {
+        keyWords[i] = load32(key + 4 * i);
+    }
+    for (int i = 0; i < CHACHA_NONCE_WORDS; i++) {
+        nonceWords[i] = load32(nonce + 4 * i);
+    }
+    uint32_t block[CHACHA_BLOCK_WORDS];
+    chacha20Block(keyWords, 0, nonceWords, block);
+    for (int i = 0; i < POLY1305_KEY_BYTES; i++) {
+        polyKey[i] = static_cast<uint8_t>(block[i / 4] >> (8 * (i % 4)));
+    }
+}
+
+static void chacha20Xor(const uint32_t keyWords[CHACHA_KEY_WORDS], const uint32_t nonceWords[CHACHA_NONCE_WORDS],
+                        const uint8_t* in, size_t length, uint8_t* out) {
+    uint32_t block[CHACHA_BLOCK_WORDS];
+    for (size_t offset = 0; offset < length; offset += CHACHA_BLOCK_BYTES) {
+        chacha20Block(keyWords, static_cast<uint32_t>(1 + offset / CHACHA_BLOCK_BYTES), nonceWords, block);
+        for (size_t i = offset; i < length && i < offset + CHACHA_BLOCK_BYTES; i++) {
+            size_t k = i - offset;
+            out[i] = in[i] ^ static_cast<uint8_t>(block[k / 4] >> (8 * (k % 4)));
+        }
+    }
+}
+
+void chacha20Poly1305Seal(const uint8_t key[32], const uint8_t nonce[12], const uint8_t* aad, size_t aadLength,
+                          const uint8_t* plain, size_t length, uint8_t* out, uint8_t tag[POLY1305_TAG_BYTES]) {
+    uint32_t keyWords[CHACHA_KEY_WORDS];
+    uint32_t nonceWords[CHACHA_NONCE_WORDS];
+    uint8_t polyKey[POLY1305_KEY_BYTES];
+    chacha20Poly1305Setup(key, nonce, keyWords, nonceWords, polyKey);
+    chacha20Xor(keyWords, nonceWords, plain, length, out);
+    chacha20Poly1305Tag(polyKey, aad, aadLength, out, length, tag);
+}
+
+bool chacha20Poly1305Open(const uint8_t key[32], const uint8_t nonce[12], const uint8_t* aad, size_t aadLength,
+                          const uint8_t* cipher, size_t length, const uint8_t tag[POLY1305_TAG_BYTES], uint8_t* out) {
+    uint32_t keyWords[CHACHA_KEY_WORDS];
+    uint32_t nonceWords[CHACHA_NONCE_WORDS];
+    uint8_t polyKey[POLY1305_KEY_BYTES];
+    chacha20Poly1305Setup(key, nonce, keyWords, nonceWords, polyKey);
+    uint8_t expected[POLY1305_TAG_BYTES];
+    chacha20Poly1305Tag(polyKey, aad, aadLength, cipher, length, expected);
+    uint8_t diff = 0;
+    for (int i = 0; i < POLY1305_TAG_BYTES; i++) {
+        diff |= expected[i] ^ tag[i];
+    }
+    if (diff != 0) {
+        return false;
+    }
+    chacha20Xor(keyWords, nonceWords, cipher, length, out);
+    return true;
+}
@@ -0,0 +1,48 @@
+#ifndef CHACHA_H
+#define CHACHA_H
+
+#include <cstdint>
+#include <cstddef>
+
+#define CHACHA_KEY_WORDS 8
+#define CHACHA_NONCE_WORDS 3
+#define CHACHA_BLOCK_WORDS 16
+#define CHACHA_BLOCK_BYTES 64
+#define POLY1305_KEY_BYTES 32
+#define POLY1305_TAG_BYTES 16
+
+// one 64 byte ChaCha20 keystream block as specified in RFC 8439 section 2.3
+void chacha20Block(const uint32_t key[CHACHA_KEY_WORDS], uint32_t counter, const uint32_t nonce[CHACHA_NONCE_WORDS], uint32_t out[CHACHA_BLOCK_WORDS]);
+
+// count independent keystream blocks under one key, block i uses counters[i] and nonces[3 * i, 3 * i + 3).
+// Blocks are computed eight (AVX2) or four lanes at a time, so callers should hand over a whole path at once
+void chacha20Blocks(const uint32_t key[CHACHA_KEY_WORDS], const uint32_t* counters, const uint32_t* nonces, uint32_t* out, size_t count);
+
+// incremental one-time authenticator from RFC 8439 section 2.5
+struct Poly1305 {
+    uint64_t r[3];
+    uint64_t h[3];
+    uint64_t pad[2];
+    uint8_t buffer[16];
+    size_t buffered;
+
+    explicit Poly1305(const uint8_t key[POLY1305_KEY_BYTES]);
+    void update(const uint8_t* data, size_t length);
+    void finish(uint8_t tag[POLY1305_TAG_BYTES]);
+
+private:
+    void blocks(const uint8_t* data, size_t length, uint64_t hibit);
+};
+
+// AEAD_CHACHA20_POLY1305 from RFC 8439 section 2.8, out receives length bytes of ciphertext
+void chacha20Poly1305Seal(const uint8_t key[32], const uint8_t nonce[12], const uint8_t* aad, size_t aadLength,
+                          const uint8_t* plain, size_t length, uint8_t* out, uint8_t tag[POLY1305_TAG_BYTES]);
+// returns false and leaves out untouched when the tag does not match
+bool chacha20Poly1305Open(const uint8_t key[32], const uint8_t nonce[12], const uint8_t* aad, size_t aadLength,
+                          const uint8_t* cipher, size_t length, const uint8_t tag[POLY1305_TAG_BYTES], uint8_t* out);
+
+// the aad || pad || ciphertext || pad || lengths tag shared by the single shot and batched AEAD paths
+void chacha20Poly1305Tag(const uint8_t polyKey[POLY1305_KEY_BYTES], const uint8_t* aad, size_t aadLength,
+                         const uint8_t* cipher, size_t length, uint8_t tag[POLY1305_TAG_BYTES]);
+
+#endif // CHACHA_H
@@ -1,24 +1,178 @@
 #include "rgen.h"
+#include "chacha.h"
+
+#include <array>
+#include <atomic>
+
+static std::atomic<uint64_t> baseSeed{std::random_device{}() | (uint64_t(std::random_device{}()) << 32)};
+static std::atomic<RandomEngine> currentEngine{RandomEngine::XOSHIRO};
+// threads that never call seedThreadRandom take the next free stream id
+static std::atomic<uint64_t> nextStream{1};
+
+static inline uint64_t rotl64(uint64_t value, int shift) {
+    return (value << shift) | (value >> (64 - shift));
+}
+
+static inline uint64_t splitMix64(uint64_t& state) {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+struct ThreadRandom {
+    RandomEngine engine = RandomEngine::XOSHIRO;
+    bool seeded = false;
+    uint64_t xoshiro[4];
+    uint32_t key[CHACHA_KEY_WORDS];
+    uint32_t nonce[CHACHA_NONCE_WORDS];
+    uint32_t counter;
+    uint64_t buffer[CHACHA_BLOCK_WORDS / 2];
+    size_t used;
+
+    void seed(uint64_t seed, uint64_t stream) {
+        engine = currentEngine.load(std::memory_order_relaxed);
+        uint64_t state = seed ^ (stream * 0xD1B54A32D192ED03ULL);
+        for (auto& word : xoshiro) {
+            word = splitMix64(state);
+        }
+        for (auto& word : key) {
+            word = static_cast<uint32_t>(splitMix64(state));
+        }
+        nonce[0] = static_cast<uint32_t>(stream);
+        nonce[1] = static_cast<uint32_t>(stream >> 32);
+        nonce[2] = 0;
+        counter = 0;
+        used = CHACHA_BLOCK_WORDS / 2;
+        seeded = true;
+    }
+
+    uint64_t next() {
+        if (engine == RandomEngine::XOSHIRO) {
+            uint64_t result = rotl64(xoshiro[0] + xoshiro[3], 23) + xoshiro[0];
+            uint64_t t = xoshiro[1] << 17;
+            xoshiro[2] ^= xoshiro[0];
+            xoshiro[3] ^= xoshiro[1];
+            xoshiro[1] ^= xoshiro[2];
+            xoshiro[0] ^= xoshiro[3];
+            xoshiro[2] ^= t;
+            xoshiro[3] = rotl64(xoshiro[3], 45);
+            return result;
+        }
+        if (used == CHACHA_BLOCK_WORDS / 2) {
+            uint32_t words[CHACHA_BLOCK_WORDS];
+            chacha20Block(key, counter++, nonce, words);
+            if (counter == 0) {
+                nonce[2]++;
+            }
+            for (size_t i = 0; i < CHACHA_BLOCK_WORDS / 2; i++) {
+                buffer[i] = words[2 * i] | (uint64_t(words[2 * i + 1]) << 32);
+            }
+            used = 0;
+        }
+        return buffer[used++];
+    }
+};
+
+static thread_local ThreadRandom threadRandom;
+
+static inline ThreadRandom& generator() {
+    if (!threadRandom.seeded) {
+        threadRandom.seed(baseSeed.load(std::memory_order_relaxed), nextStream.fetch_add(1, std::memory_order_relaxed));
+    }
+    return threadRandom;
+}
+
+void seedRandom(uint64_t seed) {
+    baseSeed.store(seed, std::memory_order_relaxed);
+    nextStream.store(1, std::memory_order_relaxed);
+    threadRandom.seed(seed, 0);
+}
+
+void seedThreadRandom(uint64_t stream) {
+    threadRandom.seed(baseSeed.load(std::memory_order_relaxed), stream);
+}
+
+void setRandomEngine(RandomEngine engine) {
+    currentEngine.store(engine, std::memory_order_relaxed);
+    threadRandom.seed(baseSeed.load(std::memory_order_relaxed), 0);
+}
+
+bool parseRandomEngine(const std::string& name, RandomEngine& engine) {
+    if (name == "xoshiro") {
+        engine = RandomEngine::XOSHIRO;
+    } else if (name == "chacha") {
+        engine = RandomEngine::CHACHA;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+uint64_t randomU64() {
+    return generator().next();
+}
+
+// Lemire's multiply-shift reduction, rejecting the few low products that would bias the result
+static inline size_t boundedRandom(ThreadRandom& gen, uint64_t range) {
+    uint64_t x = gen.next();
+    __uint128_t product = static_cast<__uint128_t>(x) * range;
+    uint64_t low = static_cast<uint64_t>(product);
+    if (low < range) {
+        uint64_t threshold = -range % range;
+        while (low < threshold) {
+            x = gen.next();
+            product = static_cast<__uint128_t>(x) * range;
+            low = static_cast<uint64_t>(product);
+        }
+    }
+    return static_cast<size_t>(product >> 64);
+}
 
 size_t randomSizeT(size_t min, size_t max) {
-    static std::random_device rd;
-    static std::mt19937_64 gen(rd());
-    std::uniform_int_distribution<size_t> dis(min, max);
-    return dis(gen);
+    ThreadRandom& gen = generator();
+    uint64_t range = static_cast<uint64_t>(max - min) + 1;
+    if (range == 0) {
+        return gen.next();
+    }
+    return min + boundedRandom(gen, range);
 }
 
 double randomDouble(double min, double max) {
-    static std::random_device rd;
-    static std::mt19937_64 gen(rd());
-    std::uniform_real_distribution<double> dis(min, max);
-    return dis(gen);
+    // top 53 bits give a uniform double in [0, 1)
+    double unit = static_cast<double>(generator().next() >> 11) * 0x1.0p-53;
+    return min + (max - min) * unit;
+}
+
+void fillRandomSizeT(size_t* out, size_t count, size_t min, size_t max) {
+    ThreadRandom& gen = generator();
+    uint64_t range = static_cast<uint64_t>(max - min) + 1;
+    for (size_t i = 0; i < count; i++) {
+        out[i] = range == 0 ? gen.next() : min + boundedRandom(gen, range);
+    }
 }
 
+// every byte value with its bits mirrored
+static const std::array<uint8_t, 256> reversedBytes = [] {
+    std::array<uint8_t, 256> table = {};
+    for (size_t i = 0; i < 256; i++) {
+        for (size_t bit = 0; bit < 8; bit++) {
+            table[i] |= ((i >> bit) & 1) << (7 - bit);
+        }
+    }
+    return table;
+}();
+
 size_t reverseBits(size_t val, size_t bits) {
-    size_t reversed = 0;
-    for (size_t i = 0; i < bits; i ++) {
-        reversed |= (val & 1) << (bits - 1 - i);
-        val >>= 1;
+    if (bits == 0) {
+        return 0;
     }
-    return reversed;
-}
\ No newline at end of file
+    // mirror the bytes through the table, low byte first so it lands on top, then keep the top bits
+    uint64_t reversed = 0;
+    uint64_t word = val;
+    for (int i = 0; i < 8; i++) {
+        reversed = (reversed << 8) | reversedBytes[word & 0xff];
+        word >>= 8;
+    }
+    return static_cast<size_t>(reversed >> (64 - bits));
+}
@@ -1,5 +1,29 @@
+#ifndef RGEN_H
+#define RGEN_H
+
 #include <random>
+#include <cstdint>
+#include <string>
+
+// generator behind every random call, each thread owns its own instance
+enum class RandomEngine {
+    XOSHIRO,    // xoshiro256++, fast and statistically strong
+    CHACHA      // ChaCha20 keystream, cryptographically secure
+};
 
+// reseeds the calling thread and sets the base seed every thread derives its stream from
+void seedRandom(uint64_t seed);
+// derives the calling thread's generator from the base seed and a stream id, so worker i is reproducible
+void seedThreadRandom(uint64_t stream);
+// switches the engine and reseeds the calling thread, threads seeded afterwards use it too
+void setRandomEngine(RandomEngine engine);
+bool parseRandomEngine(const std::string& name, RandomEngine& engine);
+
+uint64_t randomU64();
 size_t randomSizeT(size_t min, size_t max);
 double randomDouble(double min, double max);
-size_t reverseBits(size_t value, size_t bits);
\ No newline at end of file
+// bulk uniform draws in [min, max], e.g. a batch of fresh leaf labels
+void fillRandomSizeT(size_t* out, size_t count, size_t min, size_t max);
+size_t reverseBits(size_t value, size_t bits);
+
+#endif // RGEN_H
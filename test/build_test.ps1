@@ -7,12 +7,20 @@ Write-Host "Building Path-ORAM Tests..." -ForegroundColor Cyan
 $sourceFiles = @(
     "../src/Tree.cpp",
     "../src/Forest.cpp", 
+    "../src/PositionMap.cpp",
     "../src/rgen.cpp",
+    "../src/chacha.cpp",
+    "../src/BucketCipher.cpp",
+    "../src/BucketStore.cpp",
+    "../src/StorageFile.cpp",
+    "../src/AccessStats.cpp",
+    "../src/Snapshot.cpp",
+    "../src/RemoteStore.cpp",
     "test.cpp"
 )
 
 # Compiler flags
-$cxxFlags = "-std=c++17", "-Wall", "-Wextra", "-g"
+$cxxFlags = "-std=c++17", "-Wall", "-Wextra", "-g", "-pthread"
 
 # Build test program
 Write-Host "Compiling test program..." -ForegroundColor Gray
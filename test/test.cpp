@@ -1,13 +1,92 @@
 #include "../src/Forest.h"
 #include "../src/rgen.h"
+#include "../src/chacha.h"
+#include "../src/RemoteStore.h"
+#include "../src/Snapshot.h"
 
+#include <atomic>
 #include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <new>
+#include <thread>
 
+// every operator new of the test binary is counted, so a test can check that a code path never touches the heap
+static std::atomic<uint64_t> heapAllocations{0};
 
+void* operator new(size_t size) {
+    heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size > 0 ? size : 1)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
 
-void accessTest(size_t input_size, size_t bucket_size, size_t max_tree_size, std::optional<double> rratio = std::nullopt, bool rp_flag = false) {
-    Forest forest(input_size, bucket_size, max_tree_size);
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    void* memory = nullptr;
+#ifdef _WIN32
+    memory = _aligned_malloc(size > 0 ? size : 1, static_cast<size_t>(alignment));
+#else
+    if (posix_memalign(&memory, std::max(static_cast<size_t>(alignment), sizeof(void*)), size > 0 ? size : 1) != 0) {
+        memory = nullptr;
+    }
+#endif
+    if (memory == nullptr) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+    return operator new(size, alignment);
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::align_val_t) noexcept {
+#ifdef _WIN32
+    _aligned_free(memory);
+#else
+    std::free(memory);
+#endif
+}
+
+void operator delete[](void* memory, std::align_val_t alignment) noexcept {
+    operator delete(memory, alignment);
+}
+
+void operator delete(void* memory, size_t, std::align_val_t alignment) noexcept {
+    operator delete(memory, alignment);
+}
+
+void operator delete[](void* memory, size_t, std::align_val_t alignment) noexcept {
+    operator delete(memory, alignment);
+}
+
+void accessTest(size_t input_size, size_t bucket_size, size_t max_tree_size, std::optional<double> rratio = std::nullopt, bool rp_flag = false, const TreeConfig& config = TreeConfig()) {
+    Forest forest(input_size, bucket_size, max_tree_size, config);
     std::vector<int> data_map(input_size);
     for (size_t i = 0; i < input_size; i ++) {
         int val = randomSizeT(0, INT_MAX);
@@ -24,9 +103,938 @@ void accessTest(size_t input_size, size_t bucket_size, size_t max_tree_size, std
         }
     }
     std::cout<<"stash size:"<<forest.getSizes() << std::endl;
+    if (config.posMapBudget.has_value()) {
+        std::cout<<forest.getPositionMapStats() << std::endl;
+    }
+}
+
+void parallelAccessTest(size_t input_size, size_t bucket_size, size_t max_tree_size, size_t thread_count) {
+    Forest forest(input_size, bucket_size, max_tree_size);
+    std::vector<int> data_map(input_size);
+    forest.startWorkers(thread_count);
+    std::vector<std::future<std::optional<int>>> results;
+    for (size_t i = 0; i < input_size; i ++) {
+        int val = randomSizeT(0, INT_MAX);
+        data_map[i] = val;
+        results.push_back(forest.asyncPut(i, val));
+    }
+    for (auto& result : results) {
+        result.wait();
+    }
+    results.clear();
+    for (size_t i = 0; i < input_size; i ++) {
+        results.push_back(forest.asyncGet(i));
+    }
+    for (size_t i = 0; i < input_size; i ++) {
+        std::optional<int> retrieved_val = results[i].get();
+        assert(retrieved_val.has_value() && retrieved_val.value() == data_map[i]);
+    }
+    forest.stopWorkers();
+    std::cout<<"stash size:"<<forest.getSizes() << std::endl;
+}
+
+void batchAccessTest(size_t input_size, size_t bucket_size, size_t max_tree_size, size_t batch_size, bool rp_flag = false, const TreeConfig& config = TreeConfig()) {
+    Forest forest(input_size, bucket_size, max_tree_size, config);
+    std::vector<int> data_map(input_size);
+    std::vector<AccessRequest> batch;
+    for (size_t i = 0; i < input_size; i ++) {
+        int val = randomSizeT(0, INT_MAX);
+        data_map[i] = val;
+        batch.push_back({WRITE, i, val, std::nullopt});
+        if (batch.size() == batch_size || i + 1 == input_size) {
+            forest.accessBatch(batch, false, std::nullopt, rp_flag);
+            batch.clear();
+        }
+    }
+
+    // random mixed batches, positions may repeat inside a batch
+    for (size_t round = 0; round < input_size / batch_size; round ++) {
+        std::vector<std::optional<int>> expected;
+        for (size_t j = 0; j < batch_size; j ++) {
+            size_t position = randomSizeT(0, input_size - 1);
+            if (randomSizeT(0, 1) == 0) {
+                expected.push_back(data_map[position]);
+                batch.push_back({READ, position, 0, std::nullopt});
+            } else {
+                int val = randomSizeT(0, INT_MAX);
+                data_map[position] = val;
+                expected.push_back(std::nullopt);
+                batch.push_back({WRITE, position, val, std::nullopt});
+            }
+        }
+        forest.accessBatch(batch, false, std::nullopt, rp_flag);
+        for (size_t j = 0; j < batch_size; j ++) {
+            assert(batch[j].result == expected[j]);
+        }
+        batch.clear();
+    }
+    std::cout<<"stash size:"<<forest.getSizes() << std::endl;
+}
+
+void pipelineTest(size_t input_size, size_t max_tree_size, size_t thread_count, size_t queue_depth, const TreeConfig& config) {
+    Forest forest(input_size, 4, max_tree_size, config);
+    std::vector<int> data_map(input_size);
+    // without workers the async calls are served right away
+    for (size_t i = 0; i < input_size / 2; i ++) {
+        data_map[i] = randomSizeT(0, INT_MAX);
+        assert(!forest.asyncPut(i, data_map[i]).get().has_value());
+    }
+    forest.startWorkers(thread_count, queue_depth);
+    std::vector<std::future<std::optional<int>>> results;
+    std::vector<std::optional<int>> expected;
+    for (size_t i = input_size / 2; i < input_size; i ++) {
+        data_map[i] = randomSizeT(0, INT_MAX);
+        results.push_back(forest.asyncPut(i, data_map[i]));
+        expected.push_back(std::nullopt);
+    }
+    // nothing is waited for in between, so reads meet the writes before them in the same window
+    for (size_t round = 0; round < 2 * input_size; round ++) {
+        size_t position = randomSizeT(0, input_size - 1);
+        if (randomSizeT(0, 2) == 0) {
+            data_map[position] = randomSizeT(0, INT_MAX);
+            results.push_back(forest.asyncPut(position, data_map[position]));
+            expected.push_back(std::nullopt);
+        }
+        results.push_back(forest.asyncGet(position));
+        expected.push_back(data_map[position]);
+    }
+    for (size_t i = 0; i < results.size(); i ++) {
+        assert(results[i].get() == expected[i]);
+    }
+    forest.stopWorkers();
+    assert(forest.pipelineJobs == results.size() && forest.pipelineWindows > 0);
+    std::cout<<"stash size:"<<forest.getSizes() << std::endl;
+}
+
+void evictionScheduleTest(size_t input_size, size_t eviction_rate, std::optional<double> rratio) {
+    // the table driven bit reversal against the bit by bit definition
+    for (size_t bits = 0; bits <= 40; bits ++) {
+        for (size_t round = 0; round < 64; round ++) {
+            size_t value = bits == 0 ? 0 : randomSizeT(0, (size_t(1) << bits) - 1);
+            size_t expected = 0;
+            for (size_t i = 0; i < bits; i ++) {
+                expected |= ((value >> i) & 1) << (bits - 1 - i);
+            }
+            assert(reverseBits(value, bits) == expected);
+        }
+    }
+
+    TreeConfig config;
+    config.evictionRate = eviction_rate;
+    Forest forest(input_size, 4, MAX_TREE_SIZE, config);
+    std::vector<int> data_map(input_size);
+    for (size_t i = 0; i < input_size; i ++) {
+        data_map[i] = randomSizeT(0, INT_MAX);
+        forest.put(i, data_map[i], false, rratio);
+    }
+    for (size_t round = 0; round < 2 * input_size; round ++) {
+        size_t position = randomSizeT(0, input_size - 1);
+        if (round % 2 == 0) {
+            std::optional<int> retrieved_val = forest.get(position, false, rratio);
+            assert(retrieved_val.has_value() && retrieved_val.value() == data_map[position]);
+        } else {
+            data_map[position] = randomSizeT(0, INT_MAX);
+            forest.put(position, data_map[position], false, rratio);
+        }
+    }
+    // one eviction per eviction_rate accesses, walking the leaves in reverse lexicographic order
+    const Tree& tree = forest.trees[0];
+    assert(tree.scheduledEvictions * eviction_rate + tree.pendingAccesses == tree.accessCount);
+    assert(tree.ringPath == tree.scheduledEvictions % tree.leafCount);
+    std::cout<<"stash size:"<<forest.getSizes() << std::endl;
+}
+
+void ringBucketTest(size_t input_size, size_t dummy_slots, size_t payload_size) {
+    // the same workload on plain and on ring buckets, both under the same eviction schedule
+    uint64_t storeBytes[2];
+    for (size_t ring = 0; ring < 2; ring ++) {
+        TreeConfig config;
+        config.evictionRate = 3;
+        config.payloadSize = payload_size;
+        config.dummySlots = ring ? dummy_slots : 0;
+        Forest forest(input_size, 4, MAX_TREE_SIZE, config);
+        std::vector<int> data_map(input_size);
+        for (size_t i = 0; i < input_size; i ++) {
+            data_map[i] = randomSizeT(0, INT_MAX);
+            forest.put(i, data_map[i]);
+        }
+        for (size_t round = 0; round < 2 * input_size; round ++) {
+            size_t position = randomSizeT(0, input_size - 1);
+            if (round % 2 == 0) {
+                std::optional<int> retrieved_val = forest.get(position);
+                assert(retrieved_val.has_value() && retrieved_val.value() == data_map[position]);
+            } else {
+                data_map[position] = randomSizeT(0, INT_MAX);
+                forest.put(position, data_map[position]);
+            }
+        }
+        storeBytes[ring] = forest.getTransferStats().storeBytes;
+        if (!ring) {
+            continue;
+        }
+        for (Tree& tree : forest.trees) {
+            // an access reads one slot of every bucket on its path
+            assert(tree.getTransferStats().storeSlots == tree.accessCount * tree.treeLevel);
+            // the blocks of a bucket sit in distinct slots that were not read since the bucket was written
+            for (size_t nodeID = 0; nodeID < tree.nodeCount; nodeID ++) {
+                Node node = tree.node(nodeID);
+                uint64_t slots = 0;
+                for (size_t i = 0; i < node.occupied; i ++) {
+                    assert(node.slots[i] < 4 + dummy_slots && !(slots & (uint64_t(1) << node.slots[i])));
+                    slots |= uint64_t(1) << node.slots[i];
+                }
+                assert((slots & tree.usedSlots(nodeID)) == 0);
+                assert(tree.bucketReads(nodeID) < dummy_slots);
+            }
+        }
+        std::cout<<"stash size:"<<forest.getSizes() << std::endl;
+    }
+    assert(storeBytes[1] < storeBytes[0]);
+}
+
+void stashBoundTest(size_t input_size, double rratio, TreeConfig config) {
+    Forest forest(input_size, 4, MAX_TREE_SIZE, config);
+    std::vector<int> data_map(input_size);
+    for (size_t i = 0; i < input_size; i ++) {
+        data_map[i] = randomSizeT(0, INT_MAX);
+        forest.put(i, data_map[i], false, rratio);
+    }
+    for (size_t round = 0; round < 2 * input_size; round ++) {
+        size_t position = randomSizeT(0, input_size - 1);
+        if (round % 2 == 0) {
+            std::optional<int> retrieved_val = forest.get(position, false, rratio);
+            assert(retrieved_val.has_value() && retrieved_val.value() == data_map[position]);
+        } else {
+            data_map[position] = randomSizeT(0, INT_MAX);
+            forest.put(position, data_map[position], false, rratio);
+        }
+        // the bound holds after every access, not only on average
+        for (const Tree& tree : forest.trees) {
+            assert(tree.stash.size() <= config.stashLimit);
+        }
+    }
+    // the random read ratio leaves blocks behind, so the bound had to work for it
+    for (const Tree& tree : forest.trees) {
+        assert(tree.watermarkEvictions > 0);
+    }
+    std::cout<<"stash size:"<<forest.getSizes() << std::endl;
+}
+
+void stashOverflowTest(size_t input_size, size_t stuck_blocks) {
+    TreeConfig config;
+    config.stashLimit = 1;
+    config.stashWatermark = 1;
+    Tree tree(2 * input_size, 1, std::nullopt, config);
+    std::vector<size_t> positions(input_size);
+    std::vector<int> values(input_size);
+    for (size_t i = 0; i < input_size; i ++) {
+        positions[i] = i;
+        values[i] = static_cast<int>(i);
+    }
+    tree.bulkLoad(positions.data(), values.data(), input_size);
+    // more blocks on leaf 0 than its path holds, no eviction can get the stash under the limit again
+    for (size_t i = 0; i < stuck_blocks; i ++) {
+        Block block(-1, input_size + i);
+        block.leaf = 0;
+        tree.stash.add(std::move(block));
+    }
+    for (size_t round = 0; round < 100; round ++) {
+        size_t position = randomSizeT(0, input_size - 1);
+        size_t evictPath;
+        Block* block = tree.fetch(READ, position, 0, evictPath);
+        assert(block != nullptr && block->value == static_cast<int>(position));
+        tree.finishAccess(evictPath);
+    }
+    // only the first access sweeps every path, the rest get one dummy eviction each
+    assert(tree.stash.size() > config.stashLimit);
+    assert(tree.watermarkEvictions < tree.leafCount + 100);
+}
+
+void placementTest(size_t input_size, size_t max_size, PlacementKind kind) {
+    Forest forest(input_size, 4, max_size, TreeConfig(), kind);
+    assert(forest.trees.size() > 1);
+    // a bijection onto equal shares of the trees
+    const ForestPlacement& placement = forest.placement;
+    std::vector<std::vector<bool>> seen(forest.trees.size(), std::vector<bool>(placement.perTree, false));
+    std::vector<size_t> shares(forest.trees.size(), 0);
+    for (size_t position = 0; position <= input_size; position ++) {
+        size_t treeIndex;
+        size_t treePosition;
+        placement.locate(position, treeIndex, treePosition);
+        assert(treeIndex < forest.trees.size() && treePosition < placement.perTree && !seen[treeIndex][treePosition]);
+        assert(treePosition < forest.trees[treeIndex].positionMap.size());
+        seen[treeIndex][treePosition] = true;
+        shares[treeIndex]++;
+    }
+    for (size_t share : shares) {
+        assert(kind == PlacementKind::RANGE || share + 1 >= placement.perTree);
+    }
+    // writes in ascending order, so range placement fills the trees one after another and hash spreads them
+    std::vector<int> data_map(input_size);
+    for (size_t i = 0; i < input_size; i ++) {
+        data_map[i] = randomSizeT(0, INT_MAX);
+        forest.put(i, data_map[i]);
+        if (kind == PlacementKind::HASH && i + 1 == input_size / 4) {
+            for (const Tree& tree : forest.trees) {
+                assert(tree.occupied > 0);
+            }
+        }
+    }
+    for (size_t i = input_size; i > 0; i --) {
+        std::optional<int> retrieved_val = forest.get(i - 1);
+        assert(retrieved_val.has_value() && retrieved_val.value() == data_map[i - 1]);
+    }
+    assert(!forest.get(input_size).has_value());
+    std::cout<<"stash size:"<<forest.getSizes() << std::endl;
+}
+
+void randomTest() {
+    // RFC 8439 section 2.3.2 block function test vector
+    uint32_t key[CHACHA_KEY_WORDS] = {0x03020100, 0x07060504, 0x0b0a0908, 0x0f0e0d0c, 0x13121110, 0x17161514, 0x1b1a1918, 0x1f1e1d1c};
+    uint32_t nonce[CHACHA_NONCE_WORDS] = {0x09000000, 0x4a000000, 0x00000000};
+    uint32_t expected[CHACHA_BLOCK_WORDS] = {
+        0xe4e7f110, 0x15593bd1, 0x1fdd0f50, 0xc47120a3, 0xc7f4d1c7, 0x0368c033, 0x9aaa2204, 0x4e6cd4c3,
+        0x466482d2, 0x09aa9f07, 0x05d7c214, 0xa2028bd9, 0xd19c12b5, 0xb94e16de, 0xe883d0cb, 0x4e3c50a2
+    };
+    uint32_t out[CHACHA_BLOCK_WORDS];
+    chacha20Block(key, 1, nonce, out);
+    for (size_t i = 0; i < CHACHA_BLOCK_WORDS; i ++) {
+        assert(out[i] == expected[i]);
+    }
+
+    // the same seed replays the same forest, for both engines
+    for (RandomEngine engine : {RandomEngine::XOSHIRO, RandomEngine::CHACHA}) {
+        std::string sizes[2];
+        for (auto& result : sizes) {
+            setRandomEngine(engine);
+            seedRandom(42);
+            Forest forest(5000, 4, 1023);
+            for (size_t i = 0; i < 5000; i ++) {
+                forest.put(i, randomSizeT(0, INT_MAX));
+            }
+            result = forest.getSizes();
+        }
+        assert(sizes[0] == sizes[1]);
+        for (size_t i = 0; i < 1000; i ++) {
+            size_t r = randomSizeT(10, 20);
+            double d = randomDouble(0.0, 1.0);
+            assert(r >= 10 && r <= 20 && d >= 0.0 && d < 1.0);
+        }
+    }
+    setRandomEngine(RandomEngine::XOSHIRO);
+    seedRandom(randomU64());
+}
+
+static std::vector<uint8_t> fromHex(const std::string& hex) {
+    std::vector<uint8_t> bytes;
+    for (size_t i = 0; i + 1 < hex.size(); i += 2) {
+        bytes.push_back(static_cast<uint8_t>(std::stoul(hex.substr(i, 2), nullptr, 16)));
+    }
+    return bytes;
+}
+
+void encryptionTest() {
+    // RFC 8439 section 2.5.2 Poly1305 test vector
+    std::vector<uint8_t> polyKey = fromHex("85d6be7857556d337f4452fe42d506a80103808afb0db2fd4abff6af4149f51b");
+    std::string message = "Cryptographic Forum Research Group";
+    uint8_t tag[POLY1305_TAG_BYTES];
+    Poly1305 mac(polyKey.data());
+    mac.update(reinterpret_cast<const uint8_t*>(message.data()), 5);
+    mac.update(reinterpret_cast<const uint8_t*>(message.data()) + 5, message.size() - 5);
+    mac.finish(tag);
+    assert(std::memcmp(tag, fromHex("a8061dc1305136c6c22b8baf0c0127a9").data(), POLY1305_TAG_BYTES) == 0);
+
+    // RFC 8439 section 2.8.2 AEAD test vector
+    std::vector<uint8_t> key = fromHex("808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f");
+    std::vector<uint8_t> nonce = fromHex("070000004041424344454647");
+    std::vector<uint8_t> aad = fromHex("50515253c0c1c2c3c4c5c6c7");
+    std::string plain = "Ladies and Gentlemen of the class of '99: If I could offer you only one tip for the future, sunscreen would be it.";
+    std::vector<uint8_t> sealed(plain.size());
+    chacha20Poly1305Seal(key.data(), nonce.data(), aad.data(), aad.size(), reinterpret_cast<const uint8_t*>(plain.data()), plain.size(), sealed.data(), tag);
+    assert(std::memcmp(sealed.data(), fromHex("d31a8d34648e60db7b86afbc53ef7ec2").data(), 16) == 0);
+    assert(std::memcmp(tag, fromHex("1ae10b594f09e26a7e902ecbd0600691").data(), POLY1305_TAG_BYTES) == 0);
+    std::vector<uint8_t> opened(plain.size());
+    assert(chacha20Poly1305Open(key.data(), nonce.data(), aad.data(), aad.size(), sealed.data(), sealed.size(), tag, opened.data()));
+    assert(std::memcmp(opened.data(), plain.data(), plain.size()) == 0);
+    tag[0] ^= 1;
+    assert(!chacha20Poly1305Open(key.data(), nonce.data(), aad.data(), aad.size(), sealed.data(), sealed.size(), tag, opened.data()));
+
+    // the vector lanes agree with the scalar block function, 13 blocks run the 8 lane, 4 lane and scalar tails
+    uint32_t keyWords[CHACHA_KEY_WORDS] = {1, 2, 3, 4, 5, 6, 7, 8};
+    std::vector<uint32_t> counters(13), nonces(13 * CHACHA_NONCE_WORDS), lanes(13 * CHACHA_BLOCK_WORDS);
+    for (size_t i = 0; i < counters.size(); i ++) {
+        counters[i] = static_cast<uint32_t>(i * 7);
+        nonces[3 * i] = static_cast<uint32_t>(i);
+        nonces[3 * i + 1] = 0xdeadbeef;
+        nonces[3 * i + 2] = static_cast<uint32_t>(i * i);
+    }
+    chacha20Blocks(keyWords, counters.data(), nonces.data(), lanes.data(), counters.size());
+    for (size_t i = 0; i < counters.size(); i ++) {
+        uint32_t out[CHACHA_BLOCK_WORDS];
+        chacha20Block(keyWords, counters[i], &nonces[3 * i], out);
+        assert(std::memcmp(out, &lanes[i * CHACHA_BLOCK_WORDS], sizeof(out)) == 0);
+    }
+
+    // bucket records round trip, and a flipped bit or a record moved to another node id is rejected
+    for (CipherKind kind : {CipherKind::CHACHA20_POLY1305, CipherKind::AES_256_GCM}) {
+        if (!cipherAvailable(kind)) {
+            continue;
+        }
+        size_t plainSize = BUCKET_HEADER_SIZE + 4 * sizeof(Block);
+        BucketCipher cipher(kind, plainSize);
+        std::vector<uint8_t> plains(3 * plainSize), records(3 * cipher.sealedSize()), back(3 * plainSize);
+        for (size_t i = 0; i < plains.size(); i ++) {
+            plains[i] = static_cast<uint8_t>(randomSizeT(0, 255));
+        }
+        uint8_t* plainPtrs[3];
+        uint8_t* recordPtrs[3];
+        uint8_t* backPtrs[3];
+        size_t nodeIDs[3] = {0, 5, 6};
+        for (size_t i = 0; i < 3; i ++) {
+            plainPtrs[i] = &plains[i * plainSize];
+            recordPtrs[i] = &records[i * cipher.sealedSize()];
+            backPtrs[i] = &back[i * plainSize];
+        }
+        cipher.sealBatch(plainPtrs, recordPtrs, nodeIDs, 3);
+        std::vector<uint8_t> firstSeal = records;
+        assert(cipher.openBatch(recordPtrs, backPtrs, nodeIDs, 3));
+        assert(back == plains);
+        // resealing the same plaintext uses a fresh nonce
+        cipher.sealBatch(plainPtrs, recordPtrs, nodeIDs, 3);
+        assert(records != firstSeal);
+        size_t swapped[3] = {0, 6, 5};
+        assert(!cipher.openBatch(recordPtrs, backPtrs, swapped, 3));
+        records[SEALED_PREFIX_SIZE + 3] ^= 0x10;
+        assert(!cipher.openBatch(recordPtrs, backPtrs, nodeIDs, 3));
+    }
+}
+
+void fileStoreTest(size_t input_size, size_t bucket_size, CipherKind cipher) {
+    TreeConfig config;
+    config.cipher = cipher;
+    config.storePath = "store_test.oram";
+    {
+        Forest forest(input_size, bucket_size, MAX_TREE_SIZE, config);
+        assert(forest.trees.size() == 1);
+        std::vector<int> data_map(input_size);
+        for (size_t i = 0; i < input_size; i ++) {
+            data_map[i] = randomSizeT(0, INT_MAX);
+            forest.put(i, data_map[i]);
+        }
+        for (size_t i = 0; i < input_size; i ++) {
+            std::optional<int> retrieved_val = forest.get(i);
+            assert(retrieved_val.has_value() && retrieved_val.value() == data_map[i]);
+        }
+        // header page plus every record at a power of two stride, so records never straddle a page
+        const BucketStore& store = *forest.trees[0].store;
+        assert(store.recordStride() >= store.recordSize() && STORE_PAGE_SIZE % store.recordStride() == 0);
+        std::ifstream file(config.storePath, std::ios::binary | std::ios::ate);
+        assert(static_cast<size_t>(file.tellg()) == STORE_PAGE_SIZE + store.recordCount() * store.recordStride());
+        file.seekg(0);
+        char magic[8];
+        file.read(magic, sizeof(magic));
+        assert(std::memcmp(magic, "PORAMBKT", sizeof(magic)) == 0);
+        std::cout<<"stash size:"<<forest.getSizes() << std::endl;
+    }
+    std::remove(config.storePath.c_str());
+}
+
+void allocationTest(size_t input_size, size_t max_tree_size, size_t batch_size, std::optional<double> rratio, bool rp_flag, const TreeConfig& config) {
+    Forest forest(input_size, 4, max_tree_size, config);
+    std::vector<int> data_map(input_size);
+    std::vector<AccessRequest> batch;
+    batch.reserve(batch_size);
+    // the first batch of a new size reserves the scratch for it, so counting starts after one
+    if (batch_size > 0) {
+        batch.assign(batch_size, {READ, 0, 0, std::nullopt});
+        forest.accessBatch(batch, false, rratio, rp_flag);
+        batch.clear();
+    }
+    uint64_t before = heapAllocations.load();
+    for (size_t round = 0; round < 3 * input_size; round ++) {
+        // every position is written once first, then random reads and writes
+        size_t position = round < input_size ? round : randomSizeT(0, input_size - 1);
+        bool write = round < input_size || randomSizeT(0, 1) == 0;
+        int val = write ? static_cast<int>(randomSizeT(0, INT_MAX)) : 0;
+        if (batch_size == 0) {
+            if (write) {
+                forest.put(position, val, false, rratio, rp_flag);
+                data_map[position] = val;
+            } else {
+                std::optional<int> retrieved_val = forest.get(position, false, rratio, rp_flag);
+                assert(retrieved_val.has_value() && retrieved_val.value() == data_map[position]);
+            }
+            continue;
+        }
+        batch.push_back({write ? WRITE : READ, position, val, std::nullopt});
+        if (batch.size() == batch_size) {
+            forest.accessBatch(batch, false, rratio, rp_flag);
+            for (const AccessRequest& request : batch) {
+                if (request.op == WRITE) {
+                    data_map[request.position] = request.value;
+                } else {
+                    assert(request.result == data_map[request.position]);
+                }
+            }
+            batch.clear();
+        }
+    }
+    uint64_t allocations = heapAllocations.load() - before;
+    std::cout << "heap allocations over " << 3 * input_size << " accesses: " << allocations << std::endl;
+    assert(allocations == 0);
+}
+
+void remoteStoreTest(size_t input_size, size_t max_tree_size, const TreeConfig& base_config) {
+    TreeConfig config = base_config;
+    config.serverSocket = "remote_test.sock";
+    BucketServer server(config.serverSocket);
+    std::thread serving([&server]() { server.run(); });
+    {
+        Forest forest(input_size, 4, max_tree_size, config);
+        assert(!forest.trees[0].store->inPlace());
+        std::vector<int> data_map(input_size);
+        for (size_t i = 0; i < input_size; i ++) {
+            data_map[i] = randomSizeT(0, INT_MAX);
+            forest.put(i, data_map[i]);
+        }
+        BucketTransferStats before = forest.getTransferStats();
+        for (size_t i = 0; i < input_size; i ++) {
+            std::optional<int> retrieved_val = forest.get(i);
+            assert(retrieved_val.has_value() && retrieved_val.value() == data_map[i]);
+        }
+        BucketTransferStats after = forest.getTransferStats();
+        uint64_t accesses = after.accesses - before.accesses;
+        uint64_t trips = after.roundTrips - before.roundTrips;
+        if (!config.posMapBudget.has_value() && config.evictionRate == 0) {
+            // a path is one request, its write-back rides along without a round trip of its own
+            assert(trips == accesses);
+        } else {
+            assert(trips >= accesses);
+        }
+        assert(after.wireBytes - before.wireBytes >= after.storeBytes - before.storeBytes);
+
+        std::vector<AccessRequest> batch;
+        for (size_t round = 0; round < input_size / 16; round ++) {
+            for (size_t j = 0; j < 16; j ++) {
+                size_t position = randomSizeT(0, input_size - 1);
+                batch.push_back({READ, position, 0, std::nullopt});
+            }
+            forest.accessBatch(batch);
+            for (const AccessRequest& request : batch) {
+                assert(request.result == data_map[request.position]);
+            }
+            batch.clear();
+        }
+        std::cout<<"stash size:"<<forest.getSizes() << std::endl;
+    }
+    TreeConfig missing;
+    missing.serverSocket = "missing_test.sock";
+    bool refused = false;
+    try {
+        Tree tree(100, 4, std::nullopt, missing);
+    } catch (const std::runtime_error&) {
+        refused = true;
+    }
+    assert(refused);
+    server.stop();
+    serving.join();
+    assert(server.servedRequests() > 0);
+}
+
+void snapshotTest(size_t input_size, size_t max_size, const TreeConfig& config) {
+    const std::string path = "snapshot_test.snap";
+    std::vector<int> data_map(input_size);
+    std::vector<size_t> ring_paths;
+    {
+        Forest forest(input_size, 4, max_size, config);
+        for (size_t i = 0; i < input_size; i ++) {
+            data_map[i] = randomSizeT(0, INT_MAX);
+            forest.put(i, data_map[i], false, std::nullopt, true);
+        }
+        for (const auto& tree : forest.trees) {
+            ring_paths.push_back(tree.ringPath);
+        }
+        forest.save(path);
+    }
+    {
+        Forest loaded = Forest::load(path);
+        for (size_t i = 0; i < loaded.trees.size(); i ++) {
+            assert(loaded.trees[i].ringPath == ring_paths[i]);
+        }
+        for (size_t i = 0; i < input_size; i ++) {
+            std::optional<int> retrieved_val = loaded.get(i, false, std::nullopt, true);
+            assert(retrieved_val.has_value() && retrieved_val.value() == data_map[i]);
+        }
+        // writes after a load go to private pages, the snapshot itself keeps the saved values
+        for (size_t i = 0; i < input_size; i += 2) {
+            loaded.put(i, -1);
+        }
+        std::cout<<"stash size:"<<loaded.getSizes() << std::endl;
+    }
+    {
+        Forest reloaded = Forest::load(path);
+        for (size_t i = 0; i < input_size; i ++) {
+            std::optional<int> retrieved_val = reloaded.get(i);
+            assert(retrieved_val.has_value() && retrieved_val.value() == data_map[i]);
+        }
+    }
+
+    // a cut short snapshot is rejected rather than half loaded
+    std::ifstream original(path, std::ios::binary | std::ios::ate);
+    size_t length = original.tellg();
+    original.seekg(0);
+    std::vector<char> bytes(length / 2);
+    original.read(bytes.data(), bytes.size());
+    std::ofstream truncated(path, std::ios::binary | std::ios::trunc);
+    truncated.write(bytes.data(), bytes.size());
+    truncated.close();
+    bool rejected = false;
+    try {
+        Forest::load(path);
+    } catch (const std::runtime_error& e) {
+        rejected = true;
+    }
+    assert(rejected);
+    std::remove(path.c_str());
+}
+
+void snapshotValidationTest(size_t input_size) {
+    const std::string path = "snapshot_validation_test.snap";
+    // a flat label past the leaves of the tree loading it is rejected
+    {
+        PositionMap map(input_size, 16);
+        map.exchange(5, 15, true);
+        SnapshotWriter writer(path);
+        map.save(writer);
+        writer.finish();
+    }
+    {
+        SnapshotReader reader(path);
+        PositionMap loaded(reader, 16);
+        assert(loaded.peek(5) == std::optional<size_t>(15));
+    }
+    bool rejected = false;
+    try {
+        SnapshotReader reader(path);
+        PositionMap loaded(reader, 8);
+    } catch (const std::runtime_error& e) {
+        rejected = true;
+    }
+    assert(rejected);
+
+    // so is a block whose leaf lies outside the tree, wherever it sits
+    const int marker = 0x5a5a5a5a;
+    {
+        Forest forest(input_size, 4, MAX_TREE_SIZE);
+        for (size_t i = 0; i < input_size; i ++) {
+            forest.put(i, i == input_size / 2 ? marker : static_cast<int>(i));
+        }
+        forest.save(path);
+    }
+    std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+    std::vector<char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    // stale copies past a bucket's occupancy may match too, every copy gets the bad leaf
+    Block pattern(marker, input_size / 2);
+    size_t matches = 0;
+    uint32_t leaf = 0x7fffffff;
+    file.clear();
+    for (size_t offset = 0; offset + sizeof(Block) <= bytes.size(); offset ++) {
+        if (std::memcmp(&bytes[offset], &pattern, offsetof(Block, value) + sizeof(int)) == 0) {
+            file.seekp(offset + offsetof(Block, value) + sizeof(int));
+            file.write(reinterpret_cast<const char*>(&leaf), sizeof(leaf));
+            matches ++;
+        }
+    }
+    assert(matches > 0);
+    file.close();
+    rejected = false;
+    try {
+        Forest::load(path);
+    } catch (const std::runtime_error& e) {
+        rejected = true;
+    }
+    assert(rejected);
+    std::remove(path.c_str());
+}
+
+void bulkLoadTest(size_t input_size, size_t max_size, const TreeConfig& config) {
+    const char* text_path = "bulk_test.txt";
+    const char* binary_path = "bulk_test.bin";
+    std::vector<int> data_map(input_size);
+    {
+        std::ofstream text(text_path);
+        for (size_t i = 0; i < input_size; i ++) {
+            data_map[i] = randomSizeT(0, INT_MAX);
+            text << i << " " << data_map[i] << "\n";
+        }
+        // a repeated position keeps its last value, a malformed line is skipped
+        text << "not an entry\n";
+        data_map[input_size / 2] = randomSizeT(0, INT_MAX);
+        text << input_size / 2 << " " << data_map[input_size / 2] << "\n";
+    }
+    std::optional<size_t> converted = convertStorageFile(text_path, binary_path);
+    assert(converted.has_value() && converted.value() == input_size + 1);
+    assert(isStorageFile(binary_path) && !isStorageFile(text_path));
+    {
+        StorageFile storage(binary_path);
+        assert(storage.size() == input_size + 1);
+        Forest forest(storage.size(), 4, max_size, config);
+        forest.bulkLoad(storage.records(), storage.size());
+        size_t occupied = 0;
+        for (const Tree& tree : forest.trees) {
+            occupied += tree.occupied;
+        }
+        assert(occupied == input_size);
+        for (size_t i = 0; i < input_size; i ++) {
+            std::optional<int> retrieved_val = forest.get(i);
+            assert(retrieved_val.has_value() && retrieved_val.value() == data_map[i]);
+        }
+        // loaded blocks behave like written ones afterwards
+        for (size_t i = 0; i < input_size; i += 3) {
+            data_map[i] = randomSizeT(0, INT_MAX);
+            forest.put(i, data_map[i]);
+        }
+        for (size_t i = 0; i < input_size; i ++) {
+            std::optional<int> retrieved_val = forest.get(i);
+            assert(retrieved_val.has_value() && retrieved_val.value() == data_map[i]);
+        }
+        std::cout<<"stash size:"<<forest.getSizes() << std::endl;
+    }
+    std::remove(text_path);
+    std::remove(binary_path);
+}
+
+void opTraceTest(size_t op_count) {
+    const char* text_path = "trace_test.txt";
+    const char* binary_path = "trace_test.bin";
+    std::vector<TraceOp> expected;
+    {
+        std::ofstream text(text_path);
+        for (size_t i = 0; i < op_count; i ++) {
+            TraceOp op = {randomSizeT(0, SIZE_MAX / 2), static_cast<int32_t>(randomSizeT(0, UINT32_MAX)), static_cast<uint32_t>(i % 2)};
+            if (op.op == TRACE_READ) {
+                op.value = 0;
+                text << "R " << op.position << "\n";
+            } else {
+                text << "W\t" << op.position << "  " << op.value << "\r\n";
+            }
+            expected.push_back(op);
+        }
+        // malformed lines are reported and skipped, blank lines are ignored
+        text << "\nR\nW 5\nX 1 2\nW 1 99999999999\n  \nW 7 " << INT_MIN << "";
+        expected.push_back({7, INT_MIN, TRACE_WRITE});
+    }
+    std::optional<size_t> converted = convertOpFile(text_path, binary_path);
+    assert(converted.has_value() && converted.value() == expected.size());
+    for (const char* path : {text_path, binary_path}) {
+        OpTrace trace(path);
+        assert(trace.size() == expected.size());
+        for (size_t i = 0; i < expected.size(); i ++) {
+            const TraceOp& op = trace.ops()[i];
+            assert(op.op == expected[i].op && op.position == expected[i].position && op.value == expected[i].value);
+        }
+    }
+    std::remove(text_path);
+    std::remove(binary_path);
+}
+
+void accessStatsTest(size_t input_size) {
+    Forest forest(input_size, 4, MAX_TREE_SIZE);
+    for (size_t i = 0; i < input_size; i ++) {
+        forest.put(i, static_cast<int>(i));
+    }
+    for (size_t i = 0; i < input_size; i ++) {
+        assert(forest.get(i) == static_cast<int>(i));
+    }
+    AccessStats stats = forest.getAccessStats();
+    if (!ACCESS_STATS_ENABLED) {
+        // compiled out, nothing may be counted
+        assert(stats.accesses == 0 && stats.blocksRead == 0 && stats.phaseNanoseconds[PHASE_EVICTION] == 0);
+        assert(stats.toJson().find("\"enabled\":false") != std::string::npos);
+        return;
+    }
+    assert(stats.accesses == 2 * input_size);
+    assert(stats.stashLookups == stats.accesses);
+    // every block read or created ends up written back or still in the stash
+    size_t stashed = 0;
+    for (const Tree& tree : forest.trees) {
+        stashed += tree.stash.size();
+    }
+    assert(stats.blocksRead + input_size == stats.blocksWritten + stashed);
+    uint64_t samples = 0;
+    for (int i = 0; i < STASH_HISTOGRAM_BUCKETS; i ++) {
+        samples += stats.stashHistogram[i];
+    }
+    assert(samples == stats.accesses);
+    size_t path_slots = 0;
+    for (const Tree& tree : forest.trees) {
+        path_slots += tree.accessStats.accesses * tree.treeLevel * tree.bucketSize;
+    }
+    assert(stats.blocksRead + stats.dummySlotsRead == path_slots);
+    for (int i = PHASE_POSITION_MAP; i < PHASE_COUNT; i ++) {
+        assert(stats.phaseNanoseconds[i] > 0);
+    }
+    std::cout << stats.toString();
+}
+
+void positionMapTest(size_t entry_count, size_t leaf_count, size_t label_width) {
+    PositionMap map(entry_count, leaf_count);
+    assert(!map.isRecursive());
+    // labels of label_width bytes plus one presence bit per position
+    assert(map.clientBytes() == entry_count * label_width + (entry_count + 63) / 64 * sizeof(uint64_t));
+    std::vector<std::optional<size_t>> labels(entry_count);
+    for (size_t i = 0; i < entry_count; i += 3) {
+        labels[i] = i % 2 == 0 ? leaf_count - 1 : randomSizeT(0, leaf_count - 1);
+        assert(!map.exchange(i, labels[i].value(), true).has_value());
+    }
+    // a missing position stays missing unless asked to assign it
+    for (size_t i = 1; i < entry_count; i += 3) {
+        assert(!map.exchange(i, 0, false).has_value());
+    }
+    for (size_t i = 0; i < entry_count; i ++) {
+        assert(map.peek(i) == labels[i]);
+    }
+    for (size_t i = 0; i < entry_count; i += 3) {
+        size_t next = randomSizeT(0, leaf_count - 1);
+        assert(map.exchange(i, next, false) == labels[i]);
+        labels[i] = next;
+        assert(map.peek(i) == labels[i]);
+    }
+}
+
+void recursivePositionMapTest(size_t entry_count, size_t leaf_count, size_t budget) {
+    TreeConfig config;
+    config.posMapBudget = budget;
+    PositionMap map(entry_count, leaf_count, 4, config);
+    assert(map.isRecursive());
+    // 16 bit labels, 32 to a 64 byte map block, so every level shrinks the map 32 fold
+    std::vector<PositionMapLevelStats> levels = map.getLevelStats();
+    assert(levels[0].labelsPerBlock == 32);
+    for (size_t i = 1; i < levels.size(); i ++) {
+        assert(levels[i].entries <= levels[i - 1].entries / 32 + 2);
+    }
+    std::vector<std::optional<size_t>> labels(entry_count);
+    for (size_t round = 0; round < 2000; round ++) {
+        size_t position = randomSizeT(0, entry_count - 1);
+        size_t next = randomSizeT(0, leaf_count - 1);
+        assert(map.exchange(position, next, true) == labels[position]);
+        labels[position] = next;
+    }
+}
+
+void stashTest(size_t block_count, size_t leaf_depth) {
+    Stash stash(leaf_depth);
+    std::vector<size_t> leaves(block_count);
+    for (size_t i = 0; i < block_count; i ++) {
+        Block block(static_cast<int>(i), i * 7);
+        leaves[i] = randomSizeT(0, (size_t(1) << leaf_depth) - 1);
+        block.leaf = leaves[i];
+        stash.add(std::move(block));
+    }
+    // relabel half of them, the bucket lists have to follow
+    for (size_t i = 0; i < block_count; i += 2) {
+        leaves[i] = randomSizeT(0, (size_t(1) << leaf_depth) - 1);
+        stash.relabel(stash.find(i * 7), leaves[i]);
+    }
+    assert(stash.find(1) == nullptr);
+    // drain one leaf subtree at a time, every block must come out of exactly the subtree holding its leaf
+    std::vector<bool> taken(block_count, false);
+    size_t span = size_t(1) << (leaf_depth / 2);
+    for (size_t first = 0; first < (size_t(1) << leaf_depth); first += span) {
+        stash.take(first, span, SIZE_MAX, [&](Block& block, uint8_t*) {
+            size_t i = block.originalPosition / 7;
+            assert(!taken[i] && block.value == static_cast<int>(i));
+            assert(leaves[i] >= first && leaves[i] < first + span);
+            taken[i] = true;
+        });
+        for (size_t i = 0; i < block_count; i ++) {
+            assert(taken[i] == (stash.find(i * 7) == nullptr));
+        }
+    }
+    assert(stash.empty());
+    // a limit stops the pull early
+    for (size_t i = 0; i < block_count; i ++) {
+        stash.add(Block(0, i));
+    }
+    assert(stash.take(0, 1, 3, [](Block&, uint8_t*) {}) == 3);
+    assert(stash.size() == block_count - 3);
+}
+
+void topCacheTest(size_t input_size, size_t top_levels, CipherKind cipher) {
+    TreeConfig config;
+    config.cipher = cipher;
+    config.topCacheLevels = top_levels;
+    Forest forest(input_size, 4, MAX_TREE_SIZE, config);
+    std::vector<int> data_map(input_size);
+    for (size_t i = 0; i < input_size; i ++) {
+        data_map[i] = randomSizeT(0, INT_MAX);
+        forest.put(i, data_map[i]);
+    }
+    for (size_t i = 0; i < input_size; i ++) {
+        std::optional<int> retrieved_val = forest.get(i);
+        assert(retrieved_val.has_value() && retrieved_val.value() == data_map[i]);
+    }
+    // every access reads one path and writes one back, the cached levels of both never reach the store
+    const Tree& tree = forest.trees[0];
+    size_t cached = std::min(top_levels, tree.treeLevel);
+    BucketTransferStats stats = forest.getTransferStats();
+    assert(stats.accesses == 2 * input_size);
+    assert(stats.cachedBuckets == stats.accesses * 2 * cached);
+    assert(stats.storeBuckets == stats.accesses * 2 * (tree.treeLevel - cached));
+    assert(tree.store->recordCount() == tree.nodeCount - ((size_t(1) << cached) - 1));
+    std::cout<<"stash size:"<<forest.getSizes() << std::endl;
+}
+
+void payloadTest(size_t input_size, size_t payload_size, size_t max_tree_size, std::optional<double> rratio, const TreeConfig& base_config) {
+    TreeConfig config = base_config;
+    config.payloadSize = payload_size;
+    Forest forest(input_size, 4, max_tree_size, config);
+    // a byte pattern per position and version, so a payload left behind by an eviction shows up
+    auto pattern = [&](size_t position, size_t version, std::vector<uint8_t>& out) {
+        for (size_t j = 0; j < payload_size; j ++) {
+            out[j] = static_cast<uint8_t>(position * 31 + version * 7 + j);
+        }
+    };
+    std::vector<uint8_t> expected(payload_size);
+    std::vector<uint8_t> retrieved(payload_size);
+    std::vector<int> data_map(input_size);
+    for (size_t i = 0; i < input_size; i ++) {
+        data_map[i] = randomSizeT(0, INT_MAX);
+        forest.put(i, data_map[i], false, rratio);
+        pattern(i, 0, expected);
+        forest.putPayload(i, expected.data(), false, rratio);
+    }
+    // rewrite every third payload, the int values must stay untouched
+    for (size_t i = 0; i < input_size; i += 3) {
+        pattern(i, 1, expected);
+        forest.putPayload(i, expected.data(), false, rratio);
+    }
+    for (size_t i = 0; i < input_size; i ++) {
+        std::optional<int> retrieved_val = forest.get(i, false, rratio);
+        assert(retrieved_val.has_value() && retrieved_val.value() == data_map[i]);
+        pattern(i, i % 3 == 0 ? 1 : 0, expected);
+        assert(forest.getPayload(i, retrieved.data(), false, rratio));
+        assert(std::memcmp(expected.data(), retrieved.data(), payload_size) == 0);
+    }
+    // a payload written before any value reads back with value 0
+    Forest fresh(16, 4, MAX_TREE_SIZE, config);
+    pattern(5, 2, expected);
+    fresh.putPayload(5, expected.data());
+    assert(fresh.get(5).value() == 0);
+    assert(fresh.getPayload(5, retrieved.data()) && std::memcmp(expected.data(), retrieved.data(), payload_size) == 0);
+    assert(!fresh.getPayload(6, retrieved.data()));
+    std::cout<<"stash size:"<<forest.getSizes() << std::endl;
 }
 
 int main() {
+    std::cout << "Running random generator test with the ChaCha20 test vector and seeded replay." << std::endl;
+    randomTest();
+    std::cout << "Random generator test completed successfully." << std::endl;
+
+    std::cout << "Running encryption test with the RFC 8439 Poly1305 and AEAD test vectors and sealed bucket round trips." << std::endl;
+    encryptionTest();
+    std::cout << "Encryption test completed successfully." << std::endl;
+
     std::cout << "Running access test with input size 10000, bucket size 4, max tree size 65535, no random read ratio, and ring path flag set to false." << std::endl;
     accessTest(10000, 4, MAX_TREE_SIZE, std::nullopt, false);
     std::cout << "Access test completed successfully." << std::endl;
@@ -39,6 +1047,220 @@ int main() {
     accessTest(200000, 4, MAX_TREE_SIZE, 0.5, false);
     std::cout << "Access test completed successfully." << std::endl;
 
+    std::cout << "Running access test with input size 50000, bucket size 4, max tree size 65535, no random read ratio, ring path flag set to false and a 4096 byte recursive position map budget." << std::endl;
+    TreeConfig budgetConfig;
+    budgetConfig.posMapBudget = 4096;
+    accessTest(50000, 4, MAX_TREE_SIZE, std::nullopt, false, budgetConfig);
+    std::cout << "Access test completed successfully." << std::endl;
+
+    std::cout << "Running access test with input size 20000, bucket size 4, max tree size 4095, random read ratio 0.5, ring path flag set to true and ChaCha20-Poly1305 sealed buckets under a 2048 byte recursive position map budget." << std::endl;
+    TreeConfig sealedConfig;
+    sealedConfig.posMapBudget = 2048;
+    sealedConfig.cipher = CipherKind::CHACHA20_POLY1305;
+    accessTest(20000, 4, 4095, 0.5, true, sealedConfig);
+    std::cout << "Access test completed successfully." << std::endl;
+
+    std::cout << "Running file store test with input size 20000, bucket size 4 and plaintext buckets in a mapped file." << std::endl;
+    fileStoreTest(20000, 4, CipherKind::NONE);
+    std::cout << "File store test completed successfully." << std::endl;
+
+    std::cout << "Running file store test with input size 20000, bucket size 4 and ChaCha20-Poly1305 sealed buckets in a mapped file." << std::endl;
+    fileStoreTest(20000, 4, CipherKind::CHACHA20_POLY1305);
+    std::cout << "File store test completed successfully." << std::endl;
+
+    std::cout << "Running remote store test with input size 20000 over trees of max size 4095 on an in-process bucket server." << std::endl;
+    remoteStoreTest(20000, 4095, TreeConfig());
+    std::cout << "Remote store test completed successfully." << std::endl;
+
+    std::cout << "Running remote store test with input size 10000, one eviction every 3 accesses and ChaCha20-Poly1305 sealed buckets under a 2048 byte recursive position map budget on an in-process bucket server." << std::endl;
+    {
+        TreeConfig config;
+        config.evictionRate = 3;
+        config.cipher = CipherKind::CHACHA20_POLY1305;
+        config.posMapBudget = 2048;
+        remoteStoreTest(10000, MAX_TREE_SIZE, config);
+    }
+    std::cout << "Remote store test completed successfully." << std::endl;
+
+    std::cout << "Running snapshot test with input size 30000 over several trees and ring path flag set to true." << std::endl;
+    snapshotTest(30000, 4095, TreeConfig());
+    std::cout << "Snapshot test completed successfully." << std::endl;
+
+    TreeConfig snapshotConfig;
+    snapshotConfig.posMapBudget = 2048;
+    snapshotConfig.cipher = CipherKind::CHACHA20_POLY1305;
+    snapshotConfig.topCacheLevels = 3;
+    snapshotConfig.payloadSize = 24;
+    std::cout << "Running snapshot test with input size 10000, a recursive position map, a top cache, 24 byte payloads and ChaCha20-Poly1305 sealed buckets." << std::endl;
+    snapshotTest(10000, MAX_TREE_SIZE, snapshotConfig);
+    std::cout << "Snapshot test completed successfully." << std::endl;
+
+    std::cout << "Running snapshot validation test with input size 1000, a corrupt flat label and a corrupt block leaf." << std::endl;
+    snapshotValidationTest(1000);
+    std::cout << "Snapshot validation test completed successfully." << std::endl;
+
+    std::cout << "Running eviction schedule test with input size 20000, one eviction every 3 accesses and no random read ratio." << std::endl;
+    evictionScheduleTest(20000, 3, std::nullopt);
+    std::cout << "Eviction schedule test completed successfully." << std::endl;
+
+    std::cout << "Running eviction schedule test with input size 20000, one eviction every 8 accesses and random read ratio 0.2." << std::endl;
+    evictionScheduleTest(20000, 8, 0.2);
+    std::cout << "Eviction schedule test completed successfully." << std::endl;
+
+    std::cout << "Running ring bucket test with input size 20000, 6 dummy slots and 64 byte payloads." << std::endl;
+    ringBucketTest(20000, 6, 64);
+    std::cout << "Ring bucket test completed successfully." << std::endl;
+
+    TreeConfig boundConfig;
+    boundConfig.stashLimit = 16;
+    std::cout << "Running stash bound test with input size 20000, random read ratio 0.1 and a stash limit of 16." << std::endl;
+    stashBoundTest(20000, 0.1, boundConfig);
+    std::cout << "Stash bound test completed successfully." << std::endl;
+
+    boundConfig.stashWatermark = 4;
+    boundConfig.evictionRate = 6;
+    boundConfig.cipher = CipherKind::CHACHA20_POLY1305;
+    boundConfig.posMapBudget = 2048;
+    std::cout << "Running stash bound test with input size 20000, random read ratio 0.1, a stash limit of 16 and watermark of 4, one eviction every 6 accesses and ChaCha20-Poly1305 sealed buckets under a 2048 byte recursive position map budget." << std::endl;
+    stashBoundTest(20000, 0.1, boundConfig);
+    std::cout << "Stash bound test completed successfully." << std::endl;
+
+    std::cout << "Running stash overflow test with input size 2000 and 100 blocks stuck above a stash limit of 1." << std::endl;
+    stashOverflowTest(2000, 100);
+    std::cout << "Stash overflow test completed successfully." << std::endl;
+
+    TreeConfig scheduledConfig;
+    scheduledConfig.evictionRate = 2;
+    scheduledConfig.reshuffleReads = 3;
+    scheduledConfig.cipher = CipherKind::CHACHA20_POLY1305;
+    scheduledConfig.posMapBudget = 2048;
+    std::cout << "Running batch access test with input size 20000, bucket size 4, max tree size 4095, batch size 16, one eviction every 2 accesses, reshuffles after 3 reads and ChaCha20-Poly1305 sealed buckets under a 2048 byte recursive position map budget." << std::endl;
+    batchAccessTest(20000, 4, 4095, 16, false, scheduledConfig);
+    std::cout << "Batch access test completed successfully." << std::endl;
+
+    TreeConfig ringConfig;
+    ringConfig.evictionRate = 3;
+    ringConfig.dummySlots = 5;
+    ringConfig.posMapBudget = 2048;
+    ringConfig.topCacheLevels = 2;
+    std::cout << "Running batch access test with input size 20000, bucket size 4, max tree size 4095, batch size 16, ring buckets with 5 dummy slots and one eviction every 3 accesses under a 2048 byte recursive position map budget." << std::endl;
+    batchAccessTest(20000, 4, 4095, 16, false, ringConfig);
+    std::cout << "Batch access test completed successfully." << std::endl;
+
+    std::cout << "Running placement test with input size 20000 over trees of max size 1000, hash placement." << std::endl;
+    placementTest(20000, 1000, PlacementKind::HASH);
+    std::cout << "Placement test completed successfully." << std::endl;
+
+    std::cout << "Running placement test with input size 20000 over trees of max size 1000, range placement." << std::endl;
+    placementTest(20000, 1000, PlacementKind::RANGE);
+    std::cout << "Placement test completed successfully." << std::endl;
+
+    std::cout << "Running bulk load test with input size 50000 over several trees." << std::endl;
+    bulkLoadTest(50000, 4095, TreeConfig());
+    std::cout << "Bulk load test completed successfully." << std::endl;
+
+    TreeConfig bulkConfig;
+    bulkConfig.posMapBudget = 2048;
+    bulkConfig.cipher = CipherKind::CHACHA20_POLY1305;
+    bulkConfig.topCacheLevels = 3;
+    std::cout << "Running bulk load test with input size 20000, a recursive position map, a top cache and ChaCha20-Poly1305 sealed buckets." << std::endl;
+    bulkLoadTest(20000, MAX_TREE_SIZE, bulkConfig);
+    std::cout << "Bulk load test completed successfully." << std::endl;
+
+    std::cout << "Running op trace test with 10000 operations in text and binary form." << std::endl;
+    opTraceTest(10000);
+    std::cout << "Op trace test completed successfully." << std::endl;
+
+    std::cout << "Running allocation test with input size 20000, max tree size 4095, random read ratio 0.5 and ring path flag set to true." << std::endl;
+    allocationTest(20000, 4095, 0, 0.5, true, TreeConfig());
+    std::cout << "Allocation test completed successfully." << std::endl;
+
+    std::cout << "Running allocation test with input size 20000, batch size 16, one eviction every 3 accesses, a stash limit of 32 and ChaCha20-Poly1305 sealed buckets under a 2048 byte recursive position map budget." << std::endl;
+    {
+        TreeConfig config;
+        config.evictionRate = 3;
+        config.stashLimit = 32;
+        config.cipher = CipherKind::CHACHA20_POLY1305;
+        config.posMapBudget = 2048;
+        allocationTest(20000, MAX_TREE_SIZE, 16, std::nullopt, false, config);
+    }
+    std::cout << "Allocation test completed successfully." << std::endl;
+
+    std::cout << "Running allocation test with input size 20000, ring buckets with 6 dummy slots, one eviction every 3 accesses, 64 byte payloads and the top 4 levels cached." << std::endl;
+    {
+        TreeConfig config;
+        config.evictionRate = 3;
+        config.dummySlots = 6;
+        config.payloadSize = 64;
+        config.topCacheLevels = 4;
+        allocationTest(20000, MAX_TREE_SIZE, 0, std::nullopt, false, config);
+    }
+    std::cout << "Allocation test completed successfully." << std::endl;
+
+    std::cout << "Running access stats test with input size 20000, instrumentation " << (ACCESS_STATS_ENABLED ? "compiled in." : "compiled out.") << std::endl;
+    accessStatsTest(20000);
+    std::cout << "Access stats test completed successfully." << std::endl;
+
+    std::cout << "Running position map test with 1000 entries over 200, 60000, 2^20 and 2^40 leaves." << std::endl;
+    positionMapTest(1000, 200, 1);
+    positionMapTest(1000, 60000, 2);
+    positionMapTest(1000, size_t(1) << 20, 4);
+    positionMapTest(1000, size_t(1) << 40, 8);
+    std::cout << "Position map test completed successfully." << std::endl;
+
+    std::cout << "Running recursive position map test with 30001 entries over 2^14 leaves under a 1024 byte budget." << std::endl;
+    recursivePositionMapTest(30001, size_t(1) << 14, 1024);
+    std::cout << "Recursive position map test completed successfully." << std::endl;
+
+    std::cout << "Running stash test with 5000 blocks over 2^16 leaves." << std::endl;
+    stashTest(5000, 16);
+    std::cout << "Stash test completed successfully." << std::endl;
+
+    std::cout << "Running payload test with input size 20000, 4096 byte payloads, max tree size 4095 and random read ratio 0.5." << std::endl;
+    payloadTest(20000, 4096, 4095, 0.5, TreeConfig());
+    std::cout << "Payload test completed successfully." << std::endl;
+
+    std::cout << "Running payload test with input size 10000, 100 byte payloads, the top 4 levels cached and ChaCha20-Poly1305 sealed buckets." << std::endl;
+    TreeConfig payloadSealedConfig;
+    payloadSealedConfig.cipher = CipherKind::CHACHA20_POLY1305;
+    payloadSealedConfig.topCacheLevels = 4;
+    payloadTest(10000, 100, MAX_TREE_SIZE, std::nullopt, payloadSealedConfig);
+    std::cout << "Payload test completed successfully." << std::endl;
+
+    std::cout << "Running top cache test with input size 20000, bucket size 4, the top 6 levels cached and ChaCha20-Poly1305 sealed buckets below." << std::endl;
+    topCacheTest(20000, 6, CipherKind::CHACHA20_POLY1305);
+    std::cout << "Top cache test completed successfully." << std::endl;
+
+    std::cout << "Running top cache test with input size 5000, bucket size 4 and a cache deeper than the tree." << std::endl;
+    topCacheTest(5000, 64, CipherKind::NONE);
+    std::cout << "Top cache test completed successfully." << std::endl;
+
+    std::cout << "Running batch access test with input size 20000, bucket size 4, max tree size 4095, batch size 32, ring path flag set to true and AES-256-GCM sealed buckets when OpenSSL is available." << std::endl;
+    TreeConfig batchSealedConfig;
+    batchSealedConfig.cipher = cipherAvailable(CipherKind::AES_256_GCM) ? CipherKind::AES_256_GCM : CipherKind::CHACHA20_POLY1305;
+    batchAccessTest(20000, 4, 4095, 32, true, batchSealedConfig);
+    std::cout << "Access test completed successfully." << std::endl;
+
+    std::cout << "Running parallel access test with input size 100000, bucket size 4, max tree size 16383 and 4 worker threads." << std::endl;
+    parallelAccessTest(100000, 4, 16383, 4);
+    std::cout << "Access test completed successfully." << std::endl;
+
+    std::cout << "Running pipeline test with input size 20000, max tree size 1000, 2 worker threads and queue depth 8." << std::endl;
+    pipelineTest(20000, 1000, 2, 8, TreeConfig());
+    std::cout << "Pipeline test completed successfully." << std::endl;
+
+    TreeConfig pipelineConfig;
+    pipelineConfig.cipher = CipherKind::CHACHA20_POLY1305;
+    pipelineConfig.evictionRate = 3;
+    pipelineConfig.posMapBudget = 2048;
+    std::cout << "Running pipeline test with input size 20000 in one tree, queue depth 16, one eviction every 3 accesses and ChaCha20-Poly1305 sealed buckets under a 2048 byte recursive position map budget." << std::endl;
+    pipelineTest(20000, MAX_TREE_SIZE, 1, 16, pipelineConfig);
+    std::cout << "Pipeline test completed successfully." << std::endl;
+
+    std::cout << "Running batch access test with input size 50000, bucket size 4, max tree size 4095, batch size 32 and ring path flag set to true." << std::endl;
+    batchAccessTest(50000, 4, 4095, 32, true);
+    std::cout << "Access test completed successfully." << std::endl;
+
     std::cout<< "Running access test with input size 1000000, bucket size 4, max tree size 65535, no random read ratio, and ring path flag set to false." << std::endl;
     accessTest(1000000, 4, MAX_TREE_SIZE, std::nullopt, false);
     std::cout << "Access test completed successfully." << std::endl;